@@ -0,0 +1,447 @@
+/*
+ * BitmapCache.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "BitmapCache.h"
+
+#include <Autolock.h>
+#include <ByteOrder.h>
+#include <TranslatorFormats.h>
+#include <new>
+#include <string.h>
+
+
+// Images too large for the budget that are remembered at most
+static const int32 kMaxUncacheable = 64;
+
+
+struct BitmapCache::entry {
+	bitmap_cache_key	key;
+	uint8				*data;
+	size_t				size;
+	bool				pending;
+		// still being translated
+	bool				uncacheable;
+		// too large to keep, requests translate the image themselves
+	bool				linked;
+	sem_id				done;
+		// released once for every waiting request when pending ends
+	int32				references;
+		// requests waiting for or writing out data
+	entry				*next;
+};
+
+
+BitmapCacheWriter::BitmapCacheWriter(BPositionIO *target, BitmapCache &cache,
+	const bitmap_cache_key &key)
+	:
+	fTarget(target),
+	fCache(cache),
+	fKey(key),
+	fPosition(0),
+	fMaxSize(cache.Budget()),
+	fData(NULL),
+	fSize(0)
+{
+}
+
+
+BitmapCacheWriter::~BitmapCacheWriter()
+{
+	delete[] fData;
+}
+
+
+// Returns the size of the translation that starts with buffer, or 0 if
+// it does not start with a bitmap header
+static size_t
+translation_size(const void *buffer, size_t size)
+{
+	TranslatorBitmap header;
+	if (size < sizeof(header))
+		return 0;
+
+	memcpy(&header, buffer, sizeof(header));
+	if (B_BENDIAN_TO_HOST_INT32(header.magic) != B_TRANSLATOR_BITMAP)
+		return 0;
+	return sizeof(header) + B_BENDIAN_TO_HOST_INT32(header.dataSize);
+}
+
+
+ssize_t
+BitmapCacheWriter::Write(const void *buffer, size_t size)
+{
+	ssize_t written = fTarget->Write(buffer, size);
+	if (written != (ssize_t)size)
+		return written;
+
+	// The header is written first and in one piece
+	if (fPosition == 0) {
+		fSize = translation_size(buffer, size);
+		if (fSize > 0 && fSize <= fMaxSize)
+			fData = new(std::nothrow) uint8[fSize];
+		if (fData == NULL)
+			fCache._Uncacheable(fKey);
+	}
+
+	if (fData != NULL) {
+		if (fPosition + size <= fSize)
+			memcpy(fData + fPosition, buffer, size);
+		else {
+			delete[] fData;
+			fData = NULL;
+		}
+	}
+
+	fPosition += size;
+	return written;
+}
+
+
+ssize_t
+BitmapCacheWriter::ReadAt(off_t /*position*/, void * /*buffer*/,
+	size_t /*size*/)
+{
+	return B_NOT_SUPPORTED;
+}
+
+
+ssize_t
+BitmapCacheWriter::WriteAt(off_t position, const void *buffer, size_t size)
+{
+	if (position != fPosition)
+		return B_NOT_SUPPORTED;
+
+	return Write(buffer, size);
+}
+
+
+off_t
+BitmapCacheWriter::Seek(off_t position, uint32 seekMode)
+{
+	if ((seekMode == SEEK_SET && position == fPosition)
+		|| (seekMode == SEEK_CUR && position == 0))
+		return fPosition;
+
+	return B_NOT_SUPPORTED;
+}
+
+
+off_t
+BitmapCacheWriter::Position() const
+{
+	return fPosition;
+}
+
+
+//	#pragma mark -
+
+
+BitmapCache::BitmapCache()
+	:
+	fLock("heic bitmaps"),
+	fFirst(NULL),
+	fBytes(0),
+	fBudget(0),
+	fUncacheable(0),
+	fHits(0),
+	fMisses(0),
+	fCoalesced(0),
+	fEvictions(0)
+{
+}
+
+
+BitmapCache::~BitmapCache()
+{
+	while (fFirst != NULL) {
+		entry *next = fFirst->next;
+		_Free(fFirst);
+		fFirst = next;
+	}
+}
+
+
+status_t
+BitmapCache::Write(const bitmap_cache_key &key, BPositionIO *target)
+{
+	fLock.Lock();
+
+	entry *current = _Find(key);
+	bool waited = false;
+	while (current != NULL && current->pending) {
+		current->references++;
+		if (!waited)
+			fCoalesced++;
+		waited = true;
+		fLock.Unlock();
+
+		acquire_sem(current->done);
+
+		fLock.Lock();
+		current->references--;
+		if (current->data != NULL || current->uncacheable)
+			break;
+
+		// The translation failed; the first request to get here tries
+		// again, the others wait for it
+		if (!current->linked && current->references == 0)
+			_Free(current);
+		current = _Find(key);
+	}
+
+	if (current != NULL && current->uncacheable) {
+		// Translating it in parallel beats waiting in line for it
+		fMisses++;
+		fLock.Unlock();
+		return B_ENTRY_NOT_FOUND;
+	}
+
+	if (current == NULL) {
+		current = new(std::nothrow) entry;
+		if (current != NULL) {
+			current->done = create_sem(0, "heic bitmap done");
+			if (current->done < 0) {
+				delete current;
+				current = NULL;
+			}
+		}
+		if (current != NULL) {
+			current->key = key;
+			current->data = NULL;
+			current->size = 0;
+			current->pending = true;
+			current->uncacheable = false;
+			current->linked = true;
+			current->references = 0;
+			current->next = fFirst;
+			fFirst = current;
+		}
+
+		fMisses++;
+		fLock.Unlock();
+		return B_ENTRY_NOT_FOUND;
+	}
+
+	// Written out without the lock held, the reference keeps the data
+	if (current != fFirst) {
+		_Unlink(current);
+		current->linked = true;
+		current->next = fFirst;
+		fFirst = current;
+	}
+	current->references++;
+	fHits++;
+	fLock.Unlock();
+
+	ssize_t written = target->Write(current->data, current->size);
+
+	BAutolock _(fLock);
+	current->references--;
+	if (!current->linked && current->references == 0)
+		_Free(current);
+
+	if (written != (ssize_t)current->size)
+		return written < 0 ? written : B_ERROR;
+	return B_OK;
+}
+
+
+void
+BitmapCache::Store(const bitmap_cache_key &key, BitmapCacheWriter &writer)
+{
+	BAutolock _(fLock);
+
+	entry *current = _Find(key);
+	if (current == NULL || (!current->pending && !current->uncacheable))
+		return;
+
+	bool complete = writer.fData != NULL
+		&& (size_t)writer.fPosition == writer.fSize && writer.fSize <= fBudget;
+	if (!complete) {
+		if (current->pending) {
+			_Unlink(current);
+			_Finish(current);
+		}
+		return;
+	}
+
+	current->data = writer.fData;
+	current->size = writer.fSize;
+	writer.fData = NULL;
+	fBytes += current->size;
+
+	if (current->uncacheable) {
+		// The budget was raised since it was found too large
+		current->uncacheable = false;
+		fUncacheable--;
+		if (current != fFirst) {
+			_Unlink(current);
+			current->linked = true;
+			current->next = fFirst;
+			fFirst = current;
+		}
+	} else
+		_Finish(current);
+
+	_Evict();
+}
+
+
+void
+BitmapCache::Abandon(const bitmap_cache_key &key)
+{
+	BAutolock _(fLock);
+
+	entry *current = _Find(key);
+	if (current == NULL || !current->pending)
+		return;
+
+	_Unlink(current);
+	_Finish(current);
+}
+
+
+void
+BitmapCache::SetBudget(size_t budget)
+{
+	BAutolock _(fLock);
+
+	fBudget = budget;
+	_Evict();
+}
+
+
+size_t
+BitmapCache::Budget()
+{
+	BAutolock _(fLock);
+	return fBudget;
+}
+
+
+void
+BitmapCache::AddStatistics(BMessage *message)
+{
+	BAutolock _(fLock);
+
+	int64 requests = fHits + fMisses;
+	message->SetInt64("heic /bitmapCacheHits", fHits);
+	message->SetInt64("heic /bitmapCacheMisses", fMisses);
+	message->SetInt64("heic /bitmapCacheCoalesced", fCoalesced);
+	message->SetInt64("heic /bitmapCacheEvictions", fEvictions);
+	message->SetFloat("heic /bitmapCacheHitRate",
+		requests > 0 ? (float)fHits / requests : 0.0f);
+	message->SetInt64("heic /bitmapCacheBytes", fBytes);
+}
+
+
+void
+BitmapCache::_Uncacheable(const bitmap_cache_key &key)
+{
+	BAutolock _(fLock);
+
+	entry *current = _Find(key);
+	if (current == NULL || !current->pending)
+		return;
+
+	// The entry stays, without data, so that later requests do not wait
+	current->uncacheable = true;
+	fUncacheable++;
+	_Finish(current);
+	_TrimUncacheable();
+}
+
+
+BitmapCache::entry*
+BitmapCache::_Find(const bitmap_cache_key &key)
+{
+	for (entry *current = fFirst; current != NULL; current = current->next) {
+		if (current->key == key)
+			return current;
+	}
+	return NULL;
+}
+
+
+void
+BitmapCache::_Unlink(entry *current)
+{
+	for (entry **link = &fFirst; *link != NULL; link = &(*link)->next) {
+		if (*link == current) {
+			*link = current->next;
+			break;
+		}
+	}
+	current->linked = false;
+}
+
+
+void
+BitmapCache::_Finish(entry *current)
+{
+	// Wakes the waiting requests; an entry that was given up on is
+	// freed by the last of them
+	current->pending = false;
+	if (current->references > 0)
+		release_sem_etc(current->done, current->references, 0);
+	else if (!current->linked)
+		_Free(current);
+}
+
+
+void
+BitmapCache::_Evict()
+{
+	// Drop the least recently used translations nobody is writing out
+	while (fBytes > fBudget) {
+		entry **victim = NULL;
+		for (entry **link = &fFirst; *link != NULL; link = &(*link)->next) {
+			if ((*link)->data != NULL && (*link)->references == 0)
+				victim = link;
+		}
+		if (victim == NULL)
+			break;
+
+		entry *old = *victim;
+		*victim = old->next;
+		_Free(old);
+		fEvictions++;
+	}
+}
+
+
+void
+BitmapCache::_TrimUncacheable()
+{
+	while (fUncacheable > kMaxUncacheable) {
+		entry **victim = NULL;
+		for (entry **link = &fFirst; *link != NULL; link = &(*link)->next) {
+			if ((*link)->uncacheable && (*link)->references == 0)
+				victim = link;
+		}
+		if (victim == NULL)
+			break;
+
+		entry *old = *victim;
+		*victim = old->next;
+		_Free(old);
+	}
+}
+
+
+void
+BitmapCache::_Free(entry *old)
+{
+	fBytes -= old->size;
+	if (old->uncacheable)
+		fUncacheable--;
+	delete_sem(old->done);
+	delete[] old->data;
+	delete old;
+}
@@ -0,0 +1,128 @@
+/*
+ * BitmapCache.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef BITMAPCACHE_H
+#define BITMAPCACHE_H
+
+
+#include <DataIO.h>
+#include <Locker.h>
+#include <Message.h>
+#include <OS.h>
+
+#include "HEICInput.h"
+
+
+struct bitmap_cache_key {
+	file_identity		source;
+	uint64				parameters;
+		// hash of every setting that changes the output
+
+	bool operator==(const bitmap_cache_key &other) const
+	{
+		return source == other.source && parameters == other.parameters;
+	}
+};
+
+
+class BitmapCache;
+
+
+// Writes a translation through to its target and keeps a copy of it in
+// memory for BitmapCache::Store(). The bitmap header gives the size of
+// the whole translation up front; one larger than the budget of the
+// cache, or without a header, is only written through, and the requests
+// waiting for it are let go right away.
+class BitmapCacheWriter : public BPositionIO {
+public:
+								BitmapCacheWriter(BPositionIO *target,
+									BitmapCache &cache,
+									const bitmap_cache_key &key);
+	virtual						~BitmapCacheWriter();
+
+	virtual	ssize_t				Write(const void *buffer, size_t size);
+	virtual	ssize_t				ReadAt(off_t position, void *buffer,
+									size_t size);
+	virtual	ssize_t				WriteAt(off_t position, const void *buffer,
+									size_t size);
+				// writing is sequential only
+	virtual	off_t				Seek(off_t position, uint32 seekMode);
+	virtual	off_t				Position() const;
+
+private:
+	friend class BitmapCache;
+
+			BPositionIO			*fTarget;
+			BitmapCache			&fCache;
+			bitmap_cache_key	fKey;
+			off_t				fPosition;
+			size_t				fMaxSize;
+			uint8				*fData;
+				// NULL if the translation is not kept
+			size_t				fSize;
+				// of the whole translation, from its header
+};
+
+
+// Translations of files kept in memory for long running processes, like
+// thumbnail servers, that are asked for the same images over and over.
+// While an image is being translated, further requests for it wait for
+// that translation instead of decoding the image again. Beyond the byte
+// budget the least recently used translations are dropped. Images too
+// large for the budget are remembered, so that requests for them are not
+// made to wait only to translate the image one after the other.
+class BitmapCache {
+public:
+								BitmapCache();
+								~BitmapCache();
+
+			status_t			Write(const bitmap_cache_key &key,
+									BPositionIO *target);
+				// returns B_ENTRY_NOT_FOUND if the caller is to translate
+				// the image; it then has to call Store() or Abandon()
+			void				Store(const bitmap_cache_key &key,
+									BitmapCacheWriter &writer);
+			void				Abandon(const bitmap_cache_key &key);
+				// the translation failed, one of the waiting requests
+				// tries again
+
+			void				SetBudget(size_t budget);
+			size_t				Budget();
+
+			void				AddStatistics(BMessage *message);
+
+private:
+	friend class BitmapCacheWriter;
+
+			struct entry;
+
+			void				_Uncacheable(const bitmap_cache_key &key);
+			entry*				_Find(const bitmap_cache_key &key);
+			void				_Unlink(entry *current);
+			void				_Finish(entry *current);
+			void				_Evict();
+			void				_TrimUncacheable();
+			void				_Free(entry *old);
+
+			BLocker				fLock;
+			entry				*fFirst;
+				// most recently used first
+			size_t				fBytes;
+			size_t				fBudget;
+			int32				fUncacheable;
+				// entries of images too large to keep
+
+			int64				fHits;
+			int64				fMisses;
+			int64				fCoalesced;
+				// requests that waited for another to translate
+			int64				fEvictions;
+};
+
+
+#endif // BITMAPCACHE_H
@@ -0,0 +1,678 @@
+/*
+ * ColorProfile.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "ColorProfile.h"
+
+#include <Autolock.h>
+#include <libheif/heif.h>
+#include <math.h>
+#include <new>
+#include <string.h>
+
+
+static const double kSRGBPrimaries[8] = {
+	0.64, 0.33, 0.30, 0.60, 0.15, 0.06, 0.3127, 0.3290
+};
+static const double kD50White[3] = { 0.9642, 1.0, 0.8249 };
+
+// ICC parametric curves in their most general form:
+// y = (a * x + b) ^ g + e for x >= d, c * x + f below
+static const double kSRGBCurve[7] = {
+	2.4, 1 / 1.055, 0.055 / 1.055, 1 / 12.92, 0.04045, 0, 0
+};
+static const double kBT709Curve[7] = {
+	1 / 0.45, 1 / 1.099, 0.099 / 1.099, 1 / 4.5, 0.081, 0, 0
+};
+
+
+struct tone_curve {
+	double				parameters[7];
+	const uint8			*table;
+		// big endian 16 bit entries, NULL for a parametric curve
+	uint32				tableSize;
+};
+
+
+static inline uint32
+read32(const uint8 *data)
+{
+	return (uint32)data[0] << 24 | (uint32)data[1] << 16
+		| (uint32)data[2] << 8 | data[3];
+}
+
+
+static inline uint16
+read16(const uint8 *data)
+{
+	return (uint16)(data[0] << 8 | data[1]);
+}
+
+
+static inline double
+read_fixed(const uint8 *data)
+{
+	return (int32)read32(data) / 65536.0;
+}
+
+
+//	#pragma mark - matrices
+
+
+static void
+multiply(const double *a, const double *b, double *result)
+{
+	double product[9];
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			product[i * 3 + j] = a[i * 3] * b[j] + a[i * 3 + 1] * b[3 + j]
+				+ a[i * 3 + 2] * b[6 + j];
+		}
+	}
+	memcpy(result, product, sizeof(product));
+}
+
+
+static bool
+invert(const double *m, double *result)
+{
+	double inverse[9] = {
+		m[4] * m[8] - m[5] * m[7], m[2] * m[7] - m[1] * m[8],
+			m[1] * m[5] - m[2] * m[4],
+		m[5] * m[6] - m[3] * m[8], m[0] * m[8] - m[2] * m[6],
+			m[2] * m[3] - m[0] * m[5],
+		m[3] * m[7] - m[4] * m[6], m[1] * m[6] - m[0] * m[7],
+			m[0] * m[4] - m[1] * m[3]
+	};
+	double determinant = m[0] * inverse[0] + m[1] * inverse[3]
+		+ m[2] * inverse[6];
+	if (fabs(determinant) < 1e-12)
+		return false;
+
+	for (int i = 0; i < 9; i++)
+		result[i] = inverse[i] / determinant;
+	return true;
+}
+
+
+static void
+white_xyz(double x, double y, double *xyz)
+{
+	xyz[0] = x / y;
+	xyz[1] = 1.0;
+	xyz[2] = (1.0 - x - y) / y;
+}
+
+
+// RGB to XYZ for the given red, green, blue and white chromaticities
+static bool
+rgb_to_xyz(const double *primaries, double *result)
+{
+	double matrix[9];
+	for (int i = 0; i < 3; i++) {
+		double xyz[3];
+		white_xyz(primaries[i * 2], primaries[i * 2 + 1], xyz);
+		matrix[i] = xyz[0];
+		matrix[3 + i] = xyz[1];
+		matrix[6 + i] = xyz[2];
+	}
+
+	double white[3];
+	white_xyz(primaries[6], primaries[7], white);
+
+	// Scale the primaries so that they add up to the white point
+	double inverse[9];
+	if (!invert(matrix, inverse))
+		return false;
+
+	for (int i = 0; i < 3; i++) {
+		double scale = inverse[i * 3] * white[0] + inverse[i * 3 + 1] * white[1]
+			+ inverse[i * 3 + 2] * white[2];
+		for (int j = 0; j < 3; j++)
+			result[j * 3 + i] = matrix[j * 3 + i] * scale;
+	}
+	return true;
+}
+
+
+// Bradford chromatic adaptation from one white point to another
+static void
+adapt_white(const double *from, const double *to, double *result)
+{
+	static const double kBradford[9] = {
+		0.8951, 0.2664, -0.1614,
+		-0.7502, 1.7135, 0.0367,
+		0.0389, -0.0685, 1.0296
+	};
+
+	double inverse[9];
+	invert(kBradford, inverse);
+
+	double scale[9] = { 0 };
+	for (int i = 0; i < 3; i++) {
+		double coneFrom = kBradford[i * 3] * from[0]
+			+ kBradford[i * 3 + 1] * from[1] + kBradford[i * 3 + 2] * from[2];
+		double coneTo = kBradford[i * 3] * to[0]
+			+ kBradford[i * 3 + 1] * to[1] + kBradford[i * 3 + 2] * to[2];
+		scale[i * 4] = coneTo / coneFrom;
+	}
+
+	multiply(scale, kBradford, result);
+	multiply(inverse, result, result);
+}
+
+
+//	#pragma mark - curves
+
+
+static double
+evaluate_curve(const tone_curve &curve, double x)
+{
+	if (curve.table != NULL) {
+		double position = x * (curve.tableSize - 1);
+		uint32 index = min_c((uint32)position, curve.tableSize - 2);
+		double fraction = position - index;
+		double low = read16(curve.table + index * 2);
+		double high = read16(curve.table + index * 2 + 2);
+		return (low + (high - low) * fraction) / 65535.0;
+	}
+
+	const double *p = curve.parameters;
+	if (x >= p[4])
+		return pow(max_c(p[1] * x + p[2], 0.0), p[0]) + p[5];
+	return p[3] * x + p[6];
+}
+
+
+static void
+set_parametric(tone_curve &curve, const double *parameters)
+{
+	memcpy(curve.parameters, parameters, sizeof(curve.parameters));
+	curve.table = NULL;
+	curve.tableSize = 0;
+}
+
+
+static void
+set_gamma(tone_curve &curve, double gamma)
+{
+	const double parameters[7] = { gamma, 1, 0, 0, 0, 0, 0 };
+	set_parametric(curve, parameters);
+}
+
+
+static double
+encode_srgb(double linear)
+{
+	if (linear <= 0.0031308)
+		return 12.92 * linear;
+	return 1.055 * pow(linear, 1 / 2.4) - 0.055;
+}
+
+
+static bool
+fill_color_lut(const tone_curve *curves, const double *matrix,
+	color_lut &lut)
+{
+	const int32 maxLinear = (1 << kColorLinearBits) - 1;
+
+	for (int channel = 0; channel < 3; channel++) {
+		for (int32 i = 0; i < 256; i++) {
+			double value = evaluate_curve(curves[channel], i / 255.0);
+			value = min_c(max_c(value, 0.0), 1.0);
+			lut.toLinear[channel][i] = lround(value * maxLinear);
+		}
+	}
+
+	// Larger coefficients could overflow the 32 bit sums in the kernels,
+	// and no real pair of colour spaces gets near them
+	for (int i = 0; i < 9; i++) {
+		if (fabs(matrix[i]) > 2.5)
+			return false;
+		lut.matrix[i] = lround(matrix[i] * (1 << kColorMatrixShift));
+	}
+
+	for (int32 i = 0; i <= maxLinear; i++)
+		lut.fromLinear[i] = lround(encode_srgb((double)i / maxLinear) * 255);
+	memset(lut.fromLinear + maxLinear + 1, 255, 4);
+
+	return true;
+}
+
+
+//	#pragma mark - ICC
+
+
+static const uint8 *
+find_icc_tag(const uint8 *profile, size_t size, uint32 signature,
+	uint32 &tagSize)
+{
+	uint32 count = read32(profile + 128);
+	if (count > (size - 132) / 12)
+		return NULL;
+
+	for (uint32 i = 0; i < count; i++) {
+		const uint8 *entry = profile + 132 + i * 12;
+		if (read32(entry) != signature)
+			continue;
+
+		uint32 offset = read32(entry + 4);
+		tagSize = read32(entry + 8);
+		if (offset > size || tagSize > size - offset || tagSize < 12)
+			return NULL;
+		return profile + offset;
+	}
+
+	return NULL;
+}
+
+
+static bool
+read_icc_xyz(const uint8 *profile, size_t size, uint32 signature,
+	double *xyz)
+{
+	uint32 tagSize;
+	const uint8 *tag = find_icc_tag(profile, size, signature, tagSize);
+	if (tag == NULL || tagSize < 20 || read32(tag) != 'XYZ ')
+		return false;
+
+	for (int i = 0; i < 3; i++)
+		xyz[i] = read_fixed(tag + 8 + i * 4);
+	return true;
+}
+
+
+static bool
+read_icc_curve(const uint8 *profile, size_t size, uint32 signature,
+	tone_curve &curve)
+{
+	uint32 tagSize;
+	const uint8 *tag = find_icc_tag(profile, size, signature, tagSize);
+	if (tag == NULL)
+		return false;
+
+	if (read32(tag) == 'curv') {
+		uint32 count = read32(tag + 8);
+		if (count > (tagSize - 12) / 2)
+			return false;
+
+		if (count == 0)
+			set_gamma(curve, 1.0);
+		else if (count == 1)
+			set_gamma(curve, read16(tag + 12) / 256.0);
+		else {
+			curve.table = tag + 12;
+			curve.tableSize = count;
+		}
+		return true;
+	}
+
+	if (read32(tag) == 'para') {
+		static const uint32 kParameterCount[] = { 1, 3, 4, 5, 7 };
+		uint16 function = read16(tag + 8);
+		if (function > 4 || tagSize < 12 + kParameterCount[function] * 4)
+			return false;
+
+		double p[7] = { 0 };
+		for (uint32 i = 0; i < kParameterCount[function]; i++)
+			p[i] = read_fixed(tag + 12 + i * 4);
+
+		// Bring everything into the g, a, b, c, d, e, f form
+		double parameters[7] = { p[0], 1, 0, 0, 0, 0, 0 };
+		switch (function) {
+			case 1:
+			case 2:
+				if (p[1] == 0)
+					return false;
+				parameters[1] = p[1];
+				parameters[2] = p[2];
+				parameters[4] = -p[2] / p[1];
+				if (function == 2)
+					parameters[5] = parameters[6] = p[3];
+				break;
+			case 3:
+			case 4:
+				memcpy(parameters, p, sizeof(parameters));
+				break;
+		}
+		set_parametric(curve, parameters);
+		return true;
+	}
+
+	return false;
+}
+
+
+bool
+build_icc_color_lut(const uint8 *profile, size_t size, color_lut &lut)
+{
+	if (size < 132 || read32(profile + 16) != 'RGB '
+		|| read32(profile + 20) != 'XYZ ')
+		return false;
+
+	// Matrix/TRC profiles only; their colorants are relative to D50
+	double red[3], green[3], blue[3];
+	tone_curve curves[3];
+	if (!read_icc_xyz(profile, size, 'rXYZ', red)
+		|| !read_icc_xyz(profile, size, 'gXYZ', green)
+		|| !read_icc_xyz(profile, size, 'bXYZ', blue)
+		|| !read_icc_curve(profile, size, 'rTRC', curves[0])
+		|| !read_icc_curve(profile, size, 'gTRC', curves[1])
+		|| !read_icc_curve(profile, size, 'bTRC', curves[2]))
+		return false;
+
+	double source[9] = {
+		red[0], green[0], blue[0],
+		red[1], green[1], blue[1],
+		red[2], green[2], blue[2]
+	};
+
+	double srgb[9], d65[3], toD50[9], inverse[9];
+	rgb_to_xyz(kSRGBPrimaries, srgb);
+	white_xyz(kSRGBPrimaries[6], kSRGBPrimaries[7], d65);
+	adapt_white(d65, kD50White, toD50);
+	multiply(toD50, srgb, srgb);
+	if (!invert(srgb, inverse))
+		return false;
+
+	double matrix[9];
+	multiply(inverse, source, matrix);
+	return fill_color_lut(curves, matrix, lut);
+}
+
+
+//	#pragma mark - nclx
+
+
+bool
+build_nclx_color_lut(int32 primaries, int32 transfer,
+	const float *chromaticities, color_lut &lut)
+{
+	tone_curve curve;
+	switch (transfer) {
+		case 1:
+		case 6:
+		case 14:
+		case 15:
+			set_parametric(curve, kBT709Curve);
+			break;
+		case 2:
+		case 13:
+			set_parametric(curve, kSRGBCurve);
+			break;
+		case 4:
+			set_gamma(curve, 2.2);
+			break;
+		case 5:
+			set_gamma(curve, 2.8);
+			break;
+		case 8:
+			set_gamma(curve, 1.0);
+			break;
+		default:
+			// PQ, HLG and the log curves are not for an 8 bit pass
+			return false;
+	}
+	tone_curve curves[3] = { curve, curve, curve };
+
+	double source[9], srgb[9], inverse[9];
+	double chroma[8];
+	for (int i = 0; i < 8; i++)
+		chroma[i] = chromaticities[i];
+
+	// Unspecified primaries come without chromaticities
+	if (primaries == 2 || chroma[1] <= 0 || chroma[3] <= 0
+		|| chroma[5] <= 0 || chroma[7] <= 0)
+		memcpy(chroma, kSRGBPrimaries, sizeof(chroma));
+
+	if (!rgb_to_xyz(chroma, source) || !rgb_to_xyz(kSRGBPrimaries, srgb)
+		|| !invert(srgb, inverse))
+		return false;
+
+	double sourceWhite[3], d65[3];
+	white_xyz(chroma[6], chroma[7], sourceWhite);
+	white_xyz(kSRGBPrimaries[6], kSRGBPrimaries[7], d65);
+	if (fabs(chroma[6] - kSRGBPrimaries[6]) > 0.001
+		|| fabs(chroma[7] - kSRGBPrimaries[7]) > 0.001) {
+		double adapt[9];
+		adapt_white(sourceWhite, d65, adapt);
+		multiply(adapt, source, source);
+	}
+
+	double matrix[9];
+	multiply(inverse, source, matrix);
+	return fill_color_lut(curves, matrix, lut);
+}
+
+
+bool
+is_srgb_color_lut(const color_lut &lut)
+{
+	// Within a tenth of a percent, less than what 8 bits can show
+	const int32 kTolerance = (1 << kColorLinearBits) / 1000;
+	const int32 one = 1 << kColorMatrixShift;
+
+	for (int i = 0; i < 9; i++) {
+		int32 expected = i % 4 == 0 ? one : 0;
+		if (abs(lut.matrix[i] - expected) > one / 1000)
+			return false;
+	}
+
+	tone_curve srgb;
+	set_parametric(srgb, kSRGBCurve);
+	for (int32 i = 0; i < 256; i++) {
+		int32 expected = lround(evaluate_curve(srgb, i / 255.0)
+			* ((1 << kColorLinearBits) - 1));
+		for (int channel = 0; channel < 3; channel++) {
+			if (abs(lut.toLinear[channel][i] - expected) > kTolerance)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+//	#pragma mark - ColorLUTCache
+
+
+struct ColorLUTCache::entry {
+	uint64				key;
+	color_lut			*lut;
+		// NULL when there is nothing to convert
+	int32				references;
+	entry				*next;
+};
+
+
+// FNV-1a, profiles are small and hashed once per image
+static uint64
+hash_data(const void *data, size_t size, uint64 hash = 14695981039346656037ULL)
+{
+	const uint8 *bytes = (const uint8 *)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+
+ColorLUTCache::ColorLUTCache(int32 maxEntries)
+	:
+	fLock("heic color luts"),
+	fFirst(NULL),
+	fCount(0),
+	fMaxEntries(maxEntries),
+	fHits(0),
+	fMisses(0)
+{
+}
+
+
+ColorLUTCache::~ColorLUTCache()
+{
+	while (fFirst != NULL) {
+		entry *next = fFirst->next;
+		delete fFirst->lut;
+		delete fFirst;
+		fFirst = next;
+	}
+}
+
+
+const color_lut*
+ColorLUTCache::Acquire(const heif_image_handle *handle)
+{
+	// Images without a profile are taken to be sRGB
+	uint8 *icc = NULL;
+	size_t iccSize = 0;
+	heif_color_profile_nclx *nclx = NULL;
+	uint64 key;
+
+	heif_color_profile_type type
+		= heif_image_handle_get_color_profile_type(handle);
+	if (type == heif_color_profile_type_rICC
+		|| type == heif_color_profile_type_prof) {
+		iccSize = heif_image_handle_get_raw_color_profile_size(handle);
+		icc = new(std::nothrow) uint8[iccSize];
+		if (icc == NULL || heif_image_handle_get_raw_color_profile(handle,
+				icc).code != heif_error_Ok) {
+			delete[] icc;
+			return NULL;
+		}
+		key = hash_data(icc, iccSize);
+	} else if (heif_image_handle_get_nclx_color_profile(handle, &nclx).code
+			== heif_error_Ok) {
+		int32 values[2] = { nclx->color_primaries,
+			nclx->transfer_characteristics };
+		key = hash_data(&nclx->color_primary_red_x, sizeof(float) * 8,
+			hash_data(values, sizeof(values)));
+	} else
+		return NULL;
+
+	fLock.Lock();
+	for (entry **link = &fFirst; *link != NULL; link = &(*link)->next) {
+		entry *current = *link;
+		if (current->key != key)
+			continue;
+
+		*link = current->next;
+		current->next = fFirst;
+		fFirst = current;
+		if (current->lut != NULL)
+			current->references++;
+		fHits++;
+		fLock.Unlock();
+
+		delete[] icc;
+		heif_nclx_color_profile_free(nclx);
+		return current->lut;
+	}
+	fMisses++;
+	fLock.Unlock();
+
+	// Build the table without holding the lock
+	color_lut *lut = new(std::nothrow) color_lut;
+	bool built = false;
+	if (lut != NULL) {
+		if (icc != NULL)
+			built = build_icc_color_lut(icc, iccSize, *lut);
+		else {
+			built = build_nclx_color_lut(nclx->color_primaries,
+				nclx->transfer_characteristics, &nclx->color_primary_red_x,
+				*lut);
+		}
+	}
+	if (!built || is_srgb_color_lut(*lut)) {
+		delete lut;
+		lut = NULL;
+	}
+
+	delete[] icc;
+	heif_nclx_color_profile_free(nclx);
+
+	BAutolock _(fLock);
+
+	// Someone else may have been quicker
+	for (entry *current = fFirst; current != NULL; current = current->next) {
+		if (current->key == key) {
+			delete lut;
+			if (current->lut != NULL)
+				current->references++;
+			return current->lut;
+		}
+	}
+
+	entry *newEntry = new(std::nothrow) entry;
+	if (newEntry == NULL) {
+		delete lut;
+		return NULL;
+	}
+
+	newEntry->key = key;
+	newEntry->lut = lut;
+	newEntry->references = lut != NULL ? 1 : 0;
+	newEntry->next = fFirst;
+	fFirst = newEntry;
+	fCount++;
+
+	_Evict();
+	return lut;
+}
+
+
+void
+ColorLUTCache::Release(const color_lut *lut)
+{
+	if (lut == NULL)
+		return;
+
+	BAutolock _(fLock);
+
+	for (entry *current = fFirst; current != NULL; current = current->next) {
+		if (current->lut == lut) {
+			current->references--;
+			break;
+		}
+	}
+
+	_Evict();
+}
+
+
+void
+ColorLUTCache::AddStatistics(BMessage *message)
+{
+	BAutolock _(fLock);
+
+	message->SetInt64("heic /colorLUTHits", fHits);
+	message->SetInt64("heic /colorLUTMisses", fMisses);
+}
+
+
+void
+ColorLUTCache::_Evict()
+{
+	// Drop the least recently used tables that are not in use
+	while (fCount > fMaxEntries) {
+		entry **victim = NULL;
+		for (entry **link = &fFirst; *link != NULL; link = &(*link)->next) {
+			if ((*link)->references == 0)
+				victim = link;
+		}
+		if (victim == NULL)
+			break;
+
+		entry *old = *victim;
+		*victim = old->next;
+		delete old->lut;
+		delete old;
+		fCount--;
+	}
+}
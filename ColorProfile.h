@@ -0,0 +1,64 @@
+/*
+ * ColorProfile.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef COLORPROFILE_H
+#define COLORPROFILE_H
+
+
+#include <Locker.h>
+#include <Message.h>
+
+#include "PixelConverter.h"
+
+
+struct heif_image_handle;
+
+
+bool				build_icc_color_lut(const uint8 *profile, size_t size,
+						color_lut &lut);
+	// handles RGB matrix/TRC profiles, returns false for anything else
+bool				build_nclx_color_lut(int32 primaries, int32 transfer,
+						const float *chromaticities, color_lut &lut);
+	// chromaticities are red, green, blue and white x/y as libheif
+	// reports them; returns false for HDR and unknown transfer curves
+bool				is_srgb_color_lut(const color_lut &lut);
+
+
+// Colour lookup tables take a while to build, and a batch of photos from
+// one camera all use the same profile, so they are kept by profile.
+// Profiles that need no conversion, or that we cannot follow, are kept
+// as well so they are not looked at again.
+class ColorLUTCache {
+public:
+								ColorLUTCache(int32 maxEntries = 8);
+								~ColorLUTCache();
+
+			const color_lut*	Acquire(const heif_image_handle *handle);
+				// returns NULL if the image is sRGB already or its
+				// profile is not supported
+			void				Release(const color_lut *lut);
+
+			void				AddStatistics(BMessage *message);
+
+private:
+			struct entry;
+
+			void				_Evict();
+
+			BLocker				fLock;
+			entry				*fFirst;
+				// most recently used first
+			int32				fCount;
+			int32				fMaxEntries;
+
+			int64				fHits;
+			int64				fMisses;
+};
+
+
+#endif // COLORPROFILE_H
@@ -0,0 +1,179 @@
+/*
+ * ContextCache.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "ContextCache.h"
+
+#include <Autolock.h>
+#include <libheif/heif.h>
+#include <new>
+
+
+struct ContextCache::entry {
+	file_identity		identity;
+	heif_context		*context;
+	HEICInput			*input;
+	bigtime_t			releaseTime;
+	entry				*next;
+};
+
+
+ContextCache::ContextCache(int32 maxEntries, off_t maxBytes,
+	bigtime_t maxAge)
+	:
+	fLock("heic contexts"),
+	fFirst(NULL),
+	fCount(0),
+	fBytes(0),
+	fMaxEntries(maxEntries),
+	fMaxBytes(maxBytes),
+	fMaxAge(maxAge),
+	fHits(0),
+	fMisses(0),
+	fEvictions(0)
+{
+}
+
+
+ContextCache::~ContextCache()
+{
+	while (fFirst != NULL) {
+		entry *next = fFirst->next;
+		_Free(fFirst);
+		fFirst = next;
+	}
+}
+
+
+heif_context*
+ContextCache::Acquire(const file_identity &identity, HEICInput *&input)
+{
+	BAutolock _(fLock);
+	_Evict(system_time());
+
+	entry *found = NULL;
+	entry **link = &fFirst;
+	while (*link != NULL) {
+		entry *current = *link;
+		if (current->identity.device != identity.device
+			|| current->identity.node != identity.node) {
+			link = &current->next;
+			continue;
+		}
+
+		// Contexts of earlier versions of the file are of no further use
+		*link = current->next;
+		fCount--;
+		fBytes -= current->input->Size();
+		if (current->identity == identity)
+			found = current;
+		else {
+			_Free(current);
+			fEvictions++;
+		}
+	}
+
+	if (found == NULL) {
+		fMisses++;
+		return NULL;
+	}
+
+	fHits++;
+	heif_context *context = found->context;
+	input = found->input;
+	delete found;
+	return context;
+}
+
+
+void
+ContextCache::Release(const file_identity &identity, heif_context *context,
+	HEICInput *input)
+{
+	// Only mapped files stay valid without the stream they came from
+	entry *current = NULL;
+	if (input != NULL && input->IsMapped() && (off_t)input->Size() <= fMaxBytes)
+		current = new(std::nothrow) entry;
+	if (current == NULL) {
+		heif_context_free(context);
+		delete input;
+		return;
+	}
+
+	current->identity = identity;
+	current->context = context;
+	current->input = input;
+
+	BAutolock _(fLock);
+
+	// Another translation of the file may have put its context back first
+	for (entry *other = fFirst; other != NULL; other = other->next) {
+		if (other->identity == identity) {
+			_Free(current);
+			return;
+		}
+	}
+
+	current->releaseTime = system_time();
+	current->next = fFirst;
+	fFirst = current;
+	fCount++;
+	fBytes += input->Size();
+
+	_Evict(current->releaseTime);
+}
+
+
+void
+ContextCache::AddStatistics(BMessage *message)
+{
+	BAutolock _(fLock);
+
+	message->SetInt64("heic /contextHits", fHits);
+	message->SetInt64("heic /contextMisses", fMisses);
+	message->SetInt64("heic /contextEvictions", fEvictions);
+	message->SetInt32("heic /contextsCached", fCount);
+}
+
+
+void
+ContextCache::_Evict(bigtime_t now)
+{
+	// The list is ordered by release time, so the oldest contexts go
+	// first, whether they are too old or there are too many of them
+	int32 count = 0;
+	off_t bytes = 0;
+	entry **link = &fFirst;
+	while (*link != NULL) {
+		entry *current = *link;
+		size_t size = current->input->Size();
+		if (now - current->releaseTime < fMaxAge && count < fMaxEntries
+			&& bytes + (off_t)size <= fMaxBytes) {
+			count++;
+			bytes += size;
+			link = &current->next;
+			continue;
+		}
+
+		*link = current->next;
+		_Free(current);
+		fEvictions++;
+	}
+
+	fCount = count;
+	fBytes = bytes;
+}
+
+
+void
+ContextCache::_Free(entry *old)
+{
+	heif_context_free(old->context);
+	delete old->input;
+	delete old;
+}
@@ -0,0 +1,66 @@
+/*
+ * ContextCache.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef CONTEXTCACHE_H
+#define CONTEXTCACHE_H
+
+
+#include <Locker.h>
+#include <Message.h>
+#include <OS.h>
+
+#include "HEICInput.h"
+
+
+struct heif_context;
+
+
+// A viewer translates the same file several times in a row, for a
+// thumbnail, a preview and the full image. Parsed contexts of mapped
+// files are kept together with their mapping, so translating the file
+// again skips reading and parsing the container. A context is only used
+// by one translation at a time; it is taken out of the cache while in
+// use, and a second translation of the file meanwhile parses its own.
+class ContextCache {
+public:
+								ContextCache(int32 maxEntries = 4,
+									off_t maxBytes = 512 * 1024 * 1024LL,
+									bigtime_t maxAge = 30000000LL);
+								~ContextCache();
+
+			heif_context*		Acquire(const file_identity &identity,
+									HEICInput *&input);
+				// returns NULL if the file has no context cached
+			void				Release(const file_identity &identity,
+									heif_context *context, HEICInput *input);
+				// keeps the context and its input, or frees them both
+
+			void				AddStatistics(BMessage *message);
+
+private:
+			struct entry;
+
+			void				_Evict(bigtime_t now);
+			void				_Free(entry *old);
+
+			BLocker				fLock;
+			entry				*fFirst;
+				// most recently released first
+			int32				fCount;
+			off_t				fBytes;
+			int32				fMaxEntries;
+			off_t				fMaxBytes;
+			bigtime_t			fMaxAge;
+
+			int64				fHits;
+			int64				fMisses;
+			int64				fEvictions;
+};
+
+
+#endif // CONTEXTCACHE_H
@@ -0,0 +1,170 @@
+/*
+ * DecodeStatePool.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "DecodeStatePool.h"
+
+#include <Autolock.h>
+#include <libheif/heif.h>
+#include <new>
+
+
+DecodeState::DecodeState()
+	:
+	fOptions(heif_decoding_options_alloc()),
+	fBand(NULL),
+	fBandSize(0),
+	fNext(NULL),
+	fReleaseTime(0)
+{
+}
+
+
+DecodeState::~DecodeState()
+{
+	heif_decoding_options_free(fOptions);
+	delete[] fBand;
+}
+
+
+status_t
+DecodeState::InitCheck() const
+{
+	return fOptions != NULL ? B_OK : B_NO_MEMORY;
+}
+
+
+uint8*
+DecodeState::Band(size_t size)
+{
+	if (size <= fBandSize)
+		return fBand;
+
+	delete[] fBand;
+	fBand = new(std::nothrow) uint8[size];
+	fBandSize = fBand != NULL ? size : 0;
+	return fBand;
+}
+
+
+//	#pragma mark -
+
+
+DecodeStatePool::DecodeStatePool(int32 maxIdle, size_t maxIdleBytes,
+	bigtime_t idleTimeout)
+	:
+	fLock("heic decode states"),
+	fIdle(NULL),
+	fIdleCount(0),
+	fIdleBytes(0),
+	fMaxIdle(maxIdle),
+	fMaxIdleBytes(maxIdleBytes),
+	fIdleTimeout(idleTimeout),
+	fHits(0),
+	fMisses(0),
+	fEvictions(0)
+{
+}
+
+
+DecodeStatePool::~DecodeStatePool()
+{
+	while (fIdle != NULL) {
+		DecodeState *state = fIdle;
+		fIdle = state->fNext;
+		delete state;
+	}
+}
+
+
+DecodeState*
+DecodeStatePool::Acquire()
+{
+	fLock.Lock();
+	_EvictIdle(system_time());
+
+	DecodeState *state = fIdle;
+	if (state != NULL) {
+		fIdle = state->fNext;
+		fIdleCount--;
+		fIdleBytes -= state->fBandSize;
+		fHits++;
+		fLock.Unlock();
+
+		state->fNext = NULL;
+		return state;
+	}
+
+	fMisses++;
+	fLock.Unlock();
+
+	state = new(std::nothrow) DecodeState;
+	if (state != NULL && state->InitCheck() != B_OK) {
+		delete state;
+		return NULL;
+	}
+
+	return state;
+}
+
+
+void
+DecodeStatePool::Release(DecodeState *state)
+{
+	if (state == NULL)
+		return;
+
+	BAutolock _(fLock);
+
+	bigtime_t now = system_time();
+	state->fReleaseTime = now;
+	state->fNext = fIdle;
+	fIdle = state;
+	_EvictIdle(now);
+}
+
+
+void
+DecodeStatePool::AddStatistics(BMessage *message)
+{
+	BAutolock _(fLock);
+
+	message->SetInt64("heic /decodeStateHits", fHits);
+	message->SetInt64("heic /decodeStateMisses", fMisses);
+	message->SetInt64("heic /decodeStateEvictions", fEvictions);
+	message->SetInt32("heic /decodeStatesIdle", fIdleCount);
+	message->SetInt64("heic /decodeStateIdleBytes", fIdleBytes);
+}
+
+
+void
+DecodeStatePool::_EvictIdle(bigtime_t now)
+{
+	// The list is ordered by release time, so the oldest states go
+	// first, whether they are too old, too many or keep too much memory
+	int32 count = 0;
+	size_t bytes = 0;
+	DecodeState **link = &fIdle;
+	while (*link != NULL) {
+		DecodeState *state = *link;
+		if (now - state->fReleaseTime < fIdleTimeout && count < fMaxIdle
+			&& bytes + state->fBandSize <= fMaxIdleBytes) {
+			count++;
+			bytes += state->fBandSize;
+			link = &state->fNext;
+			continue;
+		}
+
+		*link = state->fNext;
+		delete state;
+		fEvictions++;
+	}
+
+	fIdleCount = count;
+	fIdleBytes = bytes;
+}
@@ -0,0 +1,85 @@
+/*
+ * DecodeStatePool.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef DECODESTATEPOOL_H
+#define DECODESTATEPOOL_H
+
+
+#include <Locker.h>
+#include <Message.h>
+#include <OS.h>
+
+
+struct heif_decoding_options;
+
+
+// Per translation scratch state: libheif decoding options and the
+// buffer the output rows are converted into. Keeping these around saves
+// the allocations, and the page faults of a fresh multi-megabyte band
+// buffer, on every image of a batch.
+class DecodeState {
+public:
+								DecodeState();
+								~DecodeState();
+
+			status_t			InitCheck() const;
+
+			heif_decoding_options* Options() { return fOptions; }
+			uint8*				Band(size_t size);
+				// returns a buffer of at least size bytes, NULL if out
+				// of memory
+
+private:
+	friend class DecodeStatePool;
+
+			heif_decoding_options* fOptions;
+			uint8				*fBand;
+			size_t				fBandSize;
+
+			DecodeState			*fNext;
+			bigtime_t			fReleaseTime;
+};
+
+
+// libheif has no way to reset a heif_context for another file, so a
+// context is created per file and kept by ContextCache; everything else
+// a translation needs comes from this pool. Idle states are only checked
+// for their age when states are acquired or released, so the band
+// buffers they may keep in the meantime are limited to maxIdleBytes.
+class DecodeStatePool {
+public:
+								DecodeStatePool(int32 maxIdle = 4,
+									size_t maxIdleBytes = 32 * 1024 * 1024,
+									bigtime_t idleTimeout = 30000000LL);
+								~DecodeStatePool();
+
+			DecodeState*		Acquire();
+			void				Release(DecodeState *state);
+
+			void				AddStatistics(BMessage *message);
+
+private:
+			void				_EvictIdle(bigtime_t now);
+
+			BLocker				fLock;
+			DecodeState			*fIdle;
+				// most recently released first
+			int32				fIdleCount;
+			size_t				fIdleBytes;
+				// of the band buffers of the idle states
+			int32				fMaxIdle;
+			size_t				fMaxIdleBytes;
+			bigtime_t			fIdleTimeout;
+
+			int64				fHits;
+			int64				fMisses;
+			int64				fEvictions;
+};
+
+
+#endif // DECODESTATEPOOL_H
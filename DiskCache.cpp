@@ -0,0 +1,375 @@
+/*
+ * DiskCache.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "DiskCache.h"
+
+#include <Autolock.h>
+#include <OS.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+
+struct cache_file_header {
+	uint32				magic;
+	uint32				version;
+	uint64				key;
+	uint64				size;
+		// of the translation that follows
+};
+
+static const uint32 kCacheFileMagic = 'hcbm';
+static const uint32 kCacheFileVersion = 1;
+static const size_t kKeyNameLength = 16;
+
+static const time_t kTemporaryFileTimeout = 3600;
+	// older temporary files were left by a writer that died
+
+
+struct cache_file {
+	time_t				used;
+	off_t				size;
+	char				name[kKeyNameLength + 1];
+};
+
+
+static int
+compare_cache_files(const void *a, const void *b)
+{
+	time_t first = ((const cache_file *)a)->used;
+	time_t second = ((const cache_file *)b)->used;
+	return first < second ? -1 : first > second ? 1 : 0;
+}
+
+
+// Eight bytes at a time, so fingerprinting a mapped file costs a small
+// fraction of decoding it
+uint64
+fingerprint_data(const void *data, size_t size, uint64 seed)
+{
+	const uint8 *bytes = (const uint8 *)data;
+	uint64 hash = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+
+	for (; size >= 8; size -= 8, bytes += 8) {
+		uint64 word;
+		memcpy(&word, bytes, sizeof(word));
+		hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 32;
+	}
+	for (; size > 0; size--, bytes++)
+		hash = (hash ^ *bytes) * 0xc4ceb9fe1a85ec53ULL;
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+
+//	#pragma mark -
+
+
+DiskCacheWriter::DiskCacheWriter(BPositionIO *target, const char *directory,
+	uint64 key, off_t maxSize)
+	:
+	fTarget(target),
+	fPosition(0),
+	fMaxSize(maxSize),
+	fKey(key),
+	fFile(-1)
+{
+	snprintf(fPath, sizeof(fPath), "%s/%016" B_PRIx64, directory, key);
+	snprintf(fTemporaryPath, sizeof(fTemporaryPath),
+		"%s/.%016" B_PRIx64 ".%" B_PRId32 ".%" B_PRId32, directory, key,
+		(int32)getpid(), (int32)find_thread(NULL));
+
+	fFile = open(fTemporaryPath, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fFile < 0)
+		return;
+
+	// The header is filled in once the size is known
+	cache_file_header header;
+	memset(&header, 0, sizeof(header));
+	if (write(fFile, &header, sizeof(header)) != sizeof(header))
+		_Abandon();
+}
+
+
+DiskCacheWriter::~DiskCacheWriter()
+{
+	if (fFile >= 0)
+		_Abandon();
+}
+
+
+ssize_t
+DiskCacheWriter::Write(const void *buffer, size_t size)
+{
+	ssize_t written = fTarget->Write(buffer, size);
+	if (written != (ssize_t)size) {
+		if (fFile >= 0)
+			_Abandon();
+		return written;
+	}
+	fPosition += size;
+
+	// Failing to cache never fails the translation
+	if (fFile >= 0 && (fPosition > fMaxSize
+			|| write(fFile, buffer, size) != (ssize_t)size))
+		_Abandon();
+
+	return written;
+}
+
+
+ssize_t
+DiskCacheWriter::ReadAt(off_t /*position*/, void * /*buffer*/,
+	size_t /*size*/)
+{
+	return B_NOT_SUPPORTED;
+}
+
+
+ssize_t
+DiskCacheWriter::WriteAt(off_t position, const void *buffer, size_t size)
+{
+	if (position != fPosition)
+		return B_NOT_SUPPORTED;
+
+	return Write(buffer, size);
+}
+
+
+off_t
+DiskCacheWriter::Seek(off_t position, uint32 seekMode)
+{
+	if ((seekMode == SEEK_SET && position == fPosition)
+		|| (seekMode == SEEK_CUR && position == 0))
+		return fPosition;
+
+	return B_NOT_SUPPORTED;
+}
+
+
+off_t
+DiskCacheWriter::Position() const
+{
+	return fPosition;
+}
+
+
+status_t
+DiskCacheWriter::Publish()
+{
+	if (fFile < 0)
+		return B_ERROR;
+
+	cache_file_header header;
+	header.magic = kCacheFileMagic;
+	header.version = kCacheFileVersion;
+	header.key = fKey;
+	header.size = fPosition;
+	if (pwrite(fFile, &header, sizeof(header), 0) != sizeof(header)) {
+		_Abandon();
+		return B_ERROR;
+	}
+
+	close(fFile);
+	fFile = -1;
+
+	// A file another process published meanwhile is replaced with an
+	// identical one
+	if (rename(fTemporaryPath, fPath) != 0) {
+		unlink(fTemporaryPath);
+		return B_ERROR;
+	}
+
+	return B_OK;
+}
+
+
+void
+DiskCacheWriter::_Abandon()
+{
+	close(fFile);
+	fFile = -1;
+	unlink(fTemporaryPath);
+}
+
+
+//	#pragma mark -
+
+
+DiskCache::DiskCache()
+	:
+	fLock("heic disk cache"),
+	fHits(0),
+	fMisses(0),
+	fStores(0),
+	fEvictions(0)
+{
+}
+
+
+DiskCache::~DiskCache()
+{
+}
+
+
+status_t
+DiskCache::Write(const char *directory, uint64 key, BPositionIO *target)
+{
+	char path[B_PATH_NAME_LENGTH];
+	snprintf(path, sizeof(path), "%s/%016" B_PRIx64, directory, key);
+
+	// Published files never change, they are only replaced or removed,
+	// neither of which affects a mapping
+	void *mapping = MAP_FAILED;
+	struct stat stat;
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		if (fstat(fd, &stat) == 0
+			&& stat.st_size >= (off_t)sizeof(cache_file_header)) {
+			mapping = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd,
+				0);
+		}
+		close(fd);
+	}
+	if (mapping == MAP_FAILED) {
+		atomic_add64(&fMisses, 1);
+		return B_ENTRY_NOT_FOUND;
+	}
+
+	const cache_file_header *header = (const cache_file_header *)mapping;
+	if (header->magic != kCacheFileMagic
+		|| header->version != kCacheFileVersion || header->key != key
+		|| header->size != stat.st_size - sizeof(cache_file_header)) {
+		munmap(mapping, stat.st_size);
+		unlink(path);
+		atomic_add64(&fMisses, 1);
+		return B_ENTRY_NOT_FOUND;
+	}
+
+	ssize_t size = header->size;
+	ssize_t written = target->Write(header + 1, size);
+	munmap(mapping, stat.st_size);
+	if (written != size)
+		return written < 0 ? written : B_ERROR;
+
+	// The modification time orders files for eviction
+	utimes(path, NULL);
+
+	atomic_add64(&fHits, 1);
+	return B_OK;
+}
+
+
+status_t
+DiskCache::Publish(DiskCacheWriter &writer, const char *directory,
+	off_t budget)
+{
+	status_t status = writer.Publish();
+	if (status != B_OK)
+		return status;
+
+	atomic_add64(&fStores, 1);
+	_Evict(directory, budget);
+	return B_OK;
+}
+
+
+void
+DiskCache::AddStatistics(BMessage *message)
+{
+	message->SetInt64("heic /diskCacheHits", atomic_get64(&fHits));
+	message->SetInt64("heic /diskCacheMisses", atomic_get64(&fMisses));
+	message->SetInt64("heic /diskCacheStores", atomic_get64(&fStores));
+	message->SetInt64("heic /diskCacheEvictions",
+		atomic_get64(&fEvictions));
+}
+
+
+void
+DiskCache::_Evict(const char *directory, off_t budget)
+{
+	// Other processes may be evicting at the same time; files that are
+	// gone already are simply skipped
+	BAutolock _(fLock);
+
+	DIR *dir = opendir(directory);
+	if (dir == NULL)
+		return;
+
+	cache_file *files = NULL;
+	int32 count = 0;
+	int32 capacity = 0;
+	off_t total = 0;
+	time_t now = time(NULL);
+
+	while (dirent *entry = readdir(dir)) {
+		char path[B_PATH_NAME_LENGTH];
+		struct stat stat;
+		snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+		if (::stat(path, &stat) != 0 || !S_ISREG(stat.st_mode))
+			continue;
+
+		if (entry->d_name[0] == '.') {
+			if (now - stat.st_mtime > kTemporaryFileTimeout)
+				unlink(path);
+			continue;
+		}
+		if (strlen(entry->d_name) != kKeyNameLength)
+			continue;
+
+		if (count == capacity) {
+			int32 newCapacity = max_c(capacity * 2, 64);
+			cache_file *newFiles
+				= new(std::nothrow) cache_file[newCapacity];
+			if (newFiles == NULL)
+				break;
+			memcpy(newFiles, files, count * sizeof(cache_file));
+			delete[] files;
+			files = newFiles;
+			capacity = newCapacity;
+		}
+
+		files[count].used = stat.st_mtime;
+		files[count].size = stat.st_size;
+		strcpy(files[count].name, entry->d_name);
+		total += stat.st_size;
+		count++;
+	}
+	closedir(dir);
+
+	if (total > budget) {
+		qsort(files, count, sizeof(cache_file), compare_cache_files);
+
+		for (int32 i = 0; i < count && total > budget; i++) {
+			char path[B_PATH_NAME_LENGTH];
+			snprintf(path, sizeof(path), "%s/%s", directory, files[i].name);
+			if (unlink(path) == 0)
+				atomic_add64(&fEvictions, 1);
+			else if (errno != ENOENT)
+				continue;
+
+			total -= files[i].size;
+		}
+	}
+
+	delete[] files;
+}
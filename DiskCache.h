@@ -0,0 +1,90 @@
+/*
+ * DiskCache.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+
+#include <DataIO.h>
+#include <Locker.h>
+#include <Message.h>
+#include <StorageDefs.h>
+
+
+uint64				fingerprint_data(const void *data, size_t size,
+						uint64 seed = 0);
+	// not cryptographic, but every byte counts
+
+
+// Writes a translation through to its target and into a new cache file.
+// The file is written under a temporary name and only renamed into place
+// by Publish(), so other processes never see it half written.
+class DiskCacheWriter : public BPositionIO {
+public:
+								DiskCacheWriter(BPositionIO *target,
+									const char *directory, uint64 key,
+									off_t maxSize);
+	virtual						~DiskCacheWriter();
+				// removes the file unless it was published
+
+	virtual	ssize_t				Write(const void *buffer, size_t size);
+	virtual	ssize_t				ReadAt(off_t position, void *buffer,
+									size_t size);
+	virtual	ssize_t				WriteAt(off_t position, const void *buffer,
+									size_t size);
+				// writing is sequential only
+	virtual	off_t				Seek(off_t position, uint32 seekMode);
+	virtual	off_t				Position() const;
+
+			status_t			Publish();
+
+private:
+			void				_Abandon();
+
+			BPositionIO			*fTarget;
+			off_t				fPosition;
+			off_t				fMaxSize;
+			uint64				fKey;
+			int					fFile;
+				// -1 once writing the cache file failed
+			char				fPath[B_PATH_NAME_LENGTH];
+			char				fTemporaryPath[B_PATH_NAME_LENGTH];
+};
+
+
+// Decoded images kept in files, for browsers that open the same photos
+// again and again, in this process or the next. Files are named by the
+// key, which covers the image data and every setting that changes the
+// output, and are mapped straight into the target on a hit. Past the
+// size budget the least recently used files are removed; serving a file
+// counts as a use.
+class DiskCache {
+public:
+								DiskCache();
+								~DiskCache();
+
+			status_t			Write(const char *directory, uint64 key,
+									BPositionIO *target);
+				// returns B_ENTRY_NOT_FOUND if key is not cached
+			status_t			Publish(DiskCacheWriter &writer,
+									const char *directory, off_t budget);
+
+			void				AddStatistics(BMessage *message);
+
+private:
+			void				_Evict(const char *directory, off_t budget);
+
+			BLocker				fLock;
+			int64				fHits;
+			int64				fMisses;
+			int64				fStores;
+			int64				fEvictions;
+};
+
+
+#endif // DISKCACHE_H
@@ -0,0 +1,137 @@
+/*
+ * HEICInput.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "HEICInput.h"
+#include "PositionIOReader.h"
+
+#include <libheif/heif.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+HEICInput::HEICInput(BPositionIO *source)
+	:
+	fSource(source),
+	fData(NULL),
+	fSize(0),
+	fMapping(NULL),
+	fReader(NULL),
+	fStatus(B_NO_INIT)
+{
+	// Memory streams can be handed to libheif as they are
+	BMallocIO *mallocIO = dynamic_cast<BMallocIO *>(source);
+	if (mallocIO != NULL) {
+		fData = (const uint8 *)mallocIO->Buffer();
+		fSize = mallocIO->BufferLength();
+		fStatus = fData != NULL && fSize > 0 ? B_OK : B_NO_TRANSLATOR;
+		return;
+	}
+
+	BFile *file = dynamic_cast<BFile *>(source);
+	if (file != NULL && _MapFile(file) == B_OK)
+		return;
+
+	fReader = new(std::nothrow) PositionIOReader(source);
+	if (fReader == NULL) {
+		fStatus = B_NO_MEMORY;
+		return;
+	}
+
+	fSize = fReader->Size();
+	fStatus = fReader->InitCheck();
+}
+
+
+HEICInput::~HEICInput()
+{
+	if (fMapping != NULL)
+		munmap(fMapping, fSize);
+	delete fReader;
+}
+
+
+BLocker*
+HEICInput::ReadLock()
+{
+	return fReader != NULL ? fReader->ReadLock() : NULL;
+}
+
+
+status_t
+HEICInput::ReadInto(heif_context *context)
+{
+	if (fStatus != B_OK)
+		return fStatus;
+
+	if (fReader != NULL)
+		return fReader->ReadInto(context);
+
+	heif_error error = heif_context_read_from_memory_without_copy(context,
+		fData, fSize, NULL);
+	if (error.code != heif_error_Ok)
+		return B_NO_TRANSLATOR;
+
+	return B_OK;
+}
+
+
+status_t
+HEICInput::_MapFile(BFile *file)
+{
+	off_t size;
+	if (file->GetSize(&size) != B_OK || size <= 0)
+		return B_ERROR;
+
+	int fd = file->Dup();
+	if (fd < 0)
+		return B_ERROR;
+
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+		// the mapping keeps its own reference to the file
+	if (mapping == MAP_FAILED)
+		return B_ERROR;
+
+	fMapping = mapping;
+	fData = (const uint8 *)mapping;
+	fSize = size;
+	fStatus = B_OK;
+	return B_OK;
+}
+
+
+//	#pragma mark -
+
+
+bool
+get_file_identity(BPositionIO *source, file_identity &identity)
+{
+	BFile *file = dynamic_cast<BFile *>(source);
+	struct stat stat;
+	if (file == NULL || file->GetStat(&stat) != B_OK)
+		return false;
+
+	identity.device = stat.st_dev;
+	identity.node = stat.st_ino;
+	identity.size = stat.st_size;
+	identity.modified = (int64)stat.st_mtim.tv_sec * 1000000000LL
+		+ stat.st_mtim.tv_nsec;
+	return true;
+}
+
+
+uint32
+hash_file_identity(const file_identity &identity)
+{
+	uint64 hash = (uint64)identity.node * 0x9e3779b97f4a7c15ULL
+		^ (uint64)identity.device * 0xc2b2ae3d27d4eb4fULL
+		^ (uint64)identity.modified ^ (uint64)identity.size << 17;
+	return (uint32)(hash ^ hash >> 32);
+}
@@ -0,0 +1,79 @@
+/*
+ * HEICInput.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef HEICINPUT_H
+#define HEICINPUT_H
+
+
+#include <DataIO.h>
+#include <File.h>
+#include <Locker.h>
+#include <SupportDefs.h>
+
+
+struct heif_context;
+class PositionIOReader;
+
+
+// Tells files apart, and a file from itself after it has changed
+struct file_identity {
+	dev_t				device;
+	ino_t				node;
+	off_t				size;
+	int64				modified;
+		// st_mtim in nanoseconds
+
+	bool operator==(const file_identity &other) const
+	{
+		return device == other.device && node == other.node
+			&& size == other.size && modified == other.modified;
+	}
+};
+
+bool				get_file_identity(BPositionIO *source,
+						file_identity &identity);
+	// returns false unless source is a file
+uint32				hash_file_identity(const file_identity &identity);
+
+
+// Makes the contents of a BPositionIO available to libheif. Files are
+// mapped read-only and memory streams are used in place; any other
+// stream is read lazily through a PositionIOReader, so libheif only
+// fetches the parts of it that it actually needs.
+class HEICInput {
+public:
+						HEICInput(BPositionIO *source);
+						~HEICInput();
+
+			status_t	InitCheck() const { return fStatus; }
+
+			const uint8* Data() const { return fData; }
+				// NULL if the input is read through a PositionIOReader
+			size_t		Size() const { return fSize; }
+			bool		IsMapped() const { return fMapping != NULL; }
+			BLocker*	ReadLock();
+				// NULL unless the input is read through a
+				// PositionIOReader, see there
+
+			status_t	ReadInto(heif_context *context);
+				// the input must outlive the context, as libheif
+				// does not copy the data
+
+private:
+			status_t	_MapFile(BFile *file);
+
+			BPositionIO	*fSource;
+			const uint8	*fData;
+			size_t		fSize;
+			void		*fMapping;
+			PositionIOReader *fReader;
+			status_t	fStatus;
+};
+
+
+#endif // HEICINPUT_H
@@ -11,7 +11,6 @@
 
 
 // Includes
-#include <Bitmap.h>
 #include <Catalog.h>
 #include <DataIO.h>
 #include <File.h>
@@ -22,15 +21,34 @@
 #include <TranslatorAddOn.h>
 #include <TranslatorFormats.h>
 #include <libheif/heif.h>
+#if LIBHEIF_HAVE_VERSION(1, 18, 0)
+#include <libheif/heif_properties.h>
+#endif
+#include <errno.h>
+#include <new>
 #include <string.h>
+#include <sys/stat.h>
 #include "HEICTranslator.h"
+#include "BitmapCache.h"
+#include "ColorProfile.h"
 #include "ConfigView.h"
+#include "ContextCache.h"
+#include "DecodeStatePool.h"
+#include "DiskCache.h"
+#include "HEICInput.h"
+#include "HEIFBrands.h"
+#include "IdentifyCache.h"
+#include "ImageTransform.h"
+#include "PixelConverter.h"
+#include "PyramidWriter.h"
+#include "Resampler.h"
 
 #undef B_TRANSLATION_CONTEXT
 #define B_TRANSLATION_CONTEXT "HEICTranslator"
 
 
-// The input formats that this translator supports.
+// The input formats that this translator supports, in the order of
+// heif_file_format
 static const translation_format sInputFormats[] = {
 	{
 		HEIC_IMAGE_FORMAT,
@@ -39,6 +57,46 @@ static const translation_format sInputFormats[] = {
 		1,
 		"image/heic",
 		"HEIC"
+	},
+	{
+		HEIC_SEQUENCE_FORMAT,
+		B_TRANSLATOR_BITMAP,
+		1,
+		1,
+		"image/heic-sequence",
+		"HEIC sequence"
+	},
+	{
+		HEIF_IMAGE_FORMAT,
+		B_TRANSLATOR_BITMAP,
+		1,
+		1,
+		"image/heif",
+		"HEIF"
+	},
+	{
+		HEIF_SEQUENCE_FORMAT,
+		B_TRANSLATOR_BITMAP,
+		1,
+		1,
+		"image/heif-sequence",
+		"HEIF sequence"
+	},
+	{
+		AVIF_IMAGE_FORMAT,
+		B_TRANSLATOR_BITMAP,
+		1,
+		1,
+		"image/avif",
+		"AVIF"
+	},
+	{
+		AVCI_IMAGE_FORMAT,
+		B_TRANSLATOR_BITMAP,
+		1,
+		1,
+		"image/avci",
+		"AVC HEIF"
 	}
 };
 
@@ -56,14 +114,966 @@ static const translation_format sOutputFormats[] = {
 
 // Default settings for the Translator
 static const TranSetting sDefaultSettings[] = {
-	{B_TRANSLATOR_EXT_HEADER_ONLY, TRAN_SETTING_BOOL, false},
-	{B_TRANSLATOR_EXT_DATA_ONLY, TRAN_SETTING_BOOL, false}
+	{HEIC_SAVED_SETTING(B_TRANSLATOR_EXT_HEADER_ONLY),
+		TRAN_SETTING_BOOL, false},
+	{HEIC_SAVED_SETTING(B_TRANSLATOR_EXT_DATA_ONLY),
+		TRAN_SETTING_BOOL, false},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_DECODER_THREADS),
+		TRAN_SETTING_INT32, 0},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_CONVERT_YCBCR),
+		TRAN_SETTING_BOOL, false},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_APPLY_TRANSFORMS),
+		TRAN_SETTING_BOOL, true},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_COLOR_MANAGEMENT),
+		TRAN_SETTING_BOOL, true},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_HIGH_BIT_DEPTH),
+		TRAN_SETTING_BOOL, true},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_IDENTIFY_CACHE),
+		TRAN_SETTING_BOOL, true},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_CONTEXT_CACHE),
+		TRAN_SETTING_BOOL, true},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_DISK_CACHE),
+		TRAN_SETTING_BOOL, false},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_DISK_CACHE_SIZE),
+		TRAN_SETTING_INT32, 256},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_BITMAP_CACHE_SIZE),
+		TRAN_SETTING_INT32, 64}
 };
 
 const uint32 kNumInputFormats = sizeof(sInputFormats) / sizeof(translation_format);
 const uint32 kNumOutputFormats = sizeof(sOutputFormats) / sizeof(translation_format);
 const uint32 kNumDefaultSettings = sizeof(sDefaultSettings) / sizeof(TranSetting);
 
+// Pixel data is converted in slices of about this size, one per thread,
+// so that a worker's output and the source rows it reads stay in its L2
+// cache. A band of slices is written out at a time, so no full size
+// copy of the output image is ever held in memory.
+static const size_t kSliceSize = 128 * 1024;
+
+// How libheif is asked for the pixels of an output color_space and how
+// they are converted from there
+struct output_layout {
+	color_space			colors;
+	heif_colorspace		space;
+	heif_chroma			chroma;
+	heif_channel		channel;
+	uint32				bytesPerPixel;
+	pixel_source		source;
+};
+
+static const output_layout kRGBA32Layout = {
+	B_RGBA32, heif_colorspace_RGB, heif_chroma_interleaved_RGBA,
+	heif_channel_interleaved, 4, PIXEL_SOURCE_RGBA8
+};
+static const output_layout kRGB32Layout = {
+	B_RGB32, heif_colorspace_RGB, heif_chroma_interleaved_RGB,
+	heif_channel_interleaved, 4, PIXEL_SOURCE_RGB8
+};
+static const output_layout kRGB24Layout = {
+	B_RGB24, heif_colorspace_RGB, heif_chroma_interleaved_RGB,
+	heif_channel_interleaved, 3, PIXEL_SOURCE_RGB8
+};
+static const output_layout kGray8Layout = {
+	B_GRAY8, heif_colorspace_monochrome, heif_chroma_monochrome,
+	heif_channel_Y, 1, PIXEL_SOURCE_GRAY8
+};
+static const output_layout kRGBA64Layout = {
+	B_RGBA64, heif_colorspace_RGB, heif_chroma_interleaved_RGBA,
+	heif_channel_interleaved, 8, PIXEL_SOURCE_RGBA8
+};
+
+
+static status_t
+write_bitmap_header(BPositionIO *target, int32 width, int32 height,
+	uint32 rowBytes, color_space colors)
+{
+	TranslatorBitmap bmp;
+	bmp.magic = B_TRANSLATOR_BITMAP;
+	bmp.bounds.Set(0, 0, width - 1, height - 1);
+	bmp.rowBytes = rowBytes;
+	bmp.colors = colors;
+	bmp.dataSize = rowBytes * height;
+
+	// Convert header to correct endianness
+	swap_data(B_UINT32_TYPE, &(bmp.magic), sizeof(uint32), B_SWAP_BENDIAN_TO_HOST);
+	swap_data(B_RECT_TYPE, &(bmp.bounds), sizeof(BRect), B_SWAP_BENDIAN_TO_HOST);
+	swap_data(B_UINT32_TYPE, &(bmp.rowBytes), sizeof(uint32), B_SWAP_BENDIAN_TO_HOST);
+	swap_data(B_UINT32_TYPE, &(bmp.colors), sizeof(color_space), B_SWAP_BENDIAN_TO_HOST);
+	swap_data(B_UINT32_TYPE, &(bmp.dataSize), sizeof(uint32), B_SWAP_BENDIAN_TO_HOST);
+
+	if (target->Write(&bmp, sizeof(TranslatorBitmap)) != sizeof(TranslatorBitmap))
+		return B_ERROR;
+
+	return B_OK;
+}
+
+
+static void
+get_image_metadata(const heif_image_handle *handle, image_metadata &metadata)
+{
+	metadata.width = heif_image_handle_get_width(handle);
+	metadata.height = heif_image_handle_get_height(handle);
+	metadata.ispeWidth = heif_image_handle_get_ispe_width(handle);
+	metadata.ispeHeight = heif_image_handle_get_ispe_height(handle);
+	metadata.lumaBits = heif_image_handle_get_luma_bits_per_pixel(handle);
+	metadata.chromaBits = heif_image_handle_get_chroma_bits_per_pixel(handle);
+	metadata.hasAlpha = heif_image_handle_has_alpha_channel(handle);
+
+	heif_colorspace space;
+	heif_chroma chroma;
+	metadata.monochrome = heif_image_handle_get_preferred_decoding_colorspace(
+			handle, &space, &chroma).code == heif_error_Ok
+		&& space == heif_colorspace_monochrome;
+}
+
+
+// Picks the smallest output that still holds everything in the image,
+// unless the caller asked for a specific one. Alpha is never dropped.
+static const output_layout &
+choose_output_layout(const image_metadata &metadata, color_space requested,
+	bool scaled)
+{
+	if (requested == B_RGBA64 && !scaled)
+		return kRGBA64Layout;
+	if (requested == B_RGBA32 || metadata.hasAlpha)
+		return kRGBA32Layout;
+	if (requested == B_RGB32 || scaled) {
+		// the resampler only writes four byte pixels
+		return kRGB32Layout;
+	}
+
+	if (metadata.monochrome && metadata.lumaBits == 8)
+		return kGray8Layout;
+
+	return requested == B_RGB24 ? kRGB24Layout : kRGB32Layout;
+}
+
+
+// Has libheif decode 10 and 12 bit images to 16 bit samples, which are
+// then widened or dithered in the output pass instead of being cut down
+// to 8 bits by its own converter
+static void
+use_high_bit_depth(const image_metadata &metadata, output_layout &layout)
+{
+	int bits = max_c(metadata.lumaBits, metadata.chromaBits);
+	pixel_source source = get_pixel_source(4, bits);
+	if (bits <= 8 || source == PIXEL_SOURCE_COUNT
+		|| layout.space != heif_colorspace_RGB)
+		return;
+
+	// libheif fills in an opaque alpha channel where there is none
+	layout.chroma = heif_chroma_interleaved_RRGGBBAA_LE;
+	layout.source = source;
+}
+
+
+// Rows are padded to whole int32s, as in a BBitmap
+static uint32
+output_row_bytes(const output_layout &layout, int32 width)
+{
+	return (width * layout.bytesPerPixel + 3) & ~(uint32)3;
+}
+
+
+struct row_bands;
+
+typedef status_t (*convert_slice_func)(const row_bands &bands,
+	int32 firstRow, int32 rowCount, uint8 *dest, int32 slot);
+
+// The output rows of an image, converted in slices on the worker pool
+// and written out in order one band of slices at a time
+struct row_bands {
+	convert_slice_func	convert;
+	int32				height;
+	size_t				rowBytes;
+	size_t				pixelBytes;
+		// bytes of each row the converter fills, the rest is cleared
+	int32				sliceRows;
+	int32				slices;
+		// per band; a slot is the index of a slice within its band
+
+	// The source, whichever parts the converter needs
+	const uint8			*data;
+	size_t				stride;
+	int32				width;
+	convert_rows_func	rowFunc;
+	const ycbcr_planes	*planes;
+	const ycbcr_coefficients *coefficients;
+	color_space			colors;
+	const Resampler		*resampler;
+	uint8				*scratch;
+	size_t				scratchSize;
+		// per slot
+	const image_transform *transform;
+	uint32				sourcePixelBytes;
+	uint32				destPixelBytes;
+
+	const color_lut		*colorLUT;
+	uint32				colorPixelBytes;
+		// of the output, set when it is to be converted to sRGB
+
+	uint8				*band;
+	int32				bandFirstRow;
+	int32				bandRows;
+};
+
+
+static void
+init_row_bands(row_bands &bands, convert_slice_func convert, int32 height,
+	size_t rowBytes, size_t pixelBytes, WorkerPool &pool, int32 threads)
+{
+	memset(&bands, 0, sizeof(bands));
+	bands.convert = convert;
+	bands.height = height;
+	bands.rowBytes = rowBytes;
+	bands.pixelBytes = pixelBytes;
+
+	// No more slices than threads, and none for small images
+	bands.sliceRows = min_c(max_c(1, (int32)(kSliceSize / rowBytes)), height);
+	int32 slices = (height + bands.sliceRows - 1) / bands.sliceRows;
+	threads = min_c(threads, pool.CountThreads() + 1);
+	bands.slices = max_c(1, min_c(slices, threads));
+}
+
+
+static status_t
+convert_slice(void *data, int32 index)
+{
+	row_bands *bands = (row_bands *)data;
+	int32 first = index * bands->sliceRows;
+	int32 rows = min_c(bands->sliceRows, bands->bandRows - first);
+
+	uint8 *dest = bands->band + first * bands->rowBytes;
+	status_t status = bands->convert(*bands, bands->bandFirstRow + first,
+		rows, dest, index);
+
+	// Right after conversion the slice is still in the cache
+	if (status == B_OK && bands->colorLUT != NULL) {
+		apply_color_lut(*bands->colorLUT, dest, bands->rowBytes,
+			bands->pixelBytes / bands->colorPixelBytes, rows,
+			bands->colorPixelBytes);
+	}
+	return status;
+}
+
+
+// The pool is shared by all translations of the add-on, so concurrent
+// ones queue for its threads rather than adding their own
+static status_t
+write_row_bands(BPositionIO *target, row_bands &bands, WorkerPool &pool,
+	int32 threads, DecodeState &state)
+{
+	int32 bandRows = min_c(bands.sliceRows * bands.slices, bands.height);
+	bands.band = state.Band(bandRows * bands.rowBytes);
+	if (bands.band == NULL)
+		return B_NO_MEMORY;
+
+	// Clear the row padding once, so that no stale data is written out
+	if (bands.pixelBytes != bands.rowBytes)
+		memset(bands.band, 0, bandRows * bands.rowBytes);
+
+	status_t status = B_OK;
+	for (int32 y = 0; y < bands.height; y += bandRows) {
+		bands.bandFirstRow = y;
+		bands.bandRows = min_c(bandRows, bands.height - y);
+
+		int32 count = (bands.bandRows + bands.sliceRows - 1) / bands.sliceRows;
+		status = pool.Run(&convert_slice, &bands, count, threads);
+		if (status != B_OK)
+			break;
+
+		ssize_t bytes = bands.bandRows * bands.rowBytes;
+		if (target->Write(bands.band, bytes) != bytes) {
+			status = B_ERROR;
+			break;
+		}
+	}
+
+	return status;
+}
+
+
+static status_t
+convert_pixel_slice(const row_bands &bands, int32 firstRow, int32 rowCount,
+	uint8 *dest, int32 /*slot*/)
+{
+	bands.rowFunc(bands.data + firstRow * bands.stride, bands.stride, dest,
+		bands.rowBytes, bands.width, rowCount, 0, firstRow);
+	return B_OK;
+}
+
+
+static status_t
+write_rows(BPositionIO *target, const uint8 *data, size_t stride,
+	int32 width, int32 height, const output_layout &layout,
+	const color_lut *lut, WorkerPool &pool, int32 threads, DecodeState &state)
+{
+	row_bands bands;
+	init_row_bands(bands, &convert_pixel_slice, height,
+		output_row_bytes(layout, width), width * layout.bytesPerPixel, pool,
+		threads);
+	bands.colorLUT = lut;
+	bands.colorPixelBytes = layout.bytesPerPixel;
+	bands.data = data;
+	bands.stride = stride;
+	bands.width = width;
+	bands.rowFunc = get_pixel_converter(layout.source, layout.colors);
+	if (bands.rowFunc == NULL)
+		return B_NO_TRANSLATOR;
+
+	return write_row_bands(target, bands, pool, threads, state);
+}
+
+
+static status_t
+transform_slice(const row_bands &bands, int32 firstRow, int32 rowCount,
+	uint8 *dest, int32 /*slot*/)
+{
+	transform_rows(*bands.transform, bands.data, bands.stride,
+		bands.sourcePixelBytes, bands.rowFunc, bands.destPixelBytes,
+		firstRow, rowCount, dest, bands.rowBytes);
+	return B_OK;
+}
+
+
+// Rotates, mirrors and crops the coded image while converting it, so
+// the caller gets the image the right way up without another pass
+static status_t
+write_transformed_rows(BPositionIO *target, const uint8 *data,
+	size_t stride, const image_transform &transform,
+	const output_layout &layout, const color_lut *lut, WorkerPool &pool,
+	int32 threads, DecodeState &state)
+{
+	row_bands bands;
+	init_row_bands(bands, &transform_slice, transform.height,
+		output_row_bytes(layout, transform.width),
+		transform.width * layout.bytesPerPixel, pool, threads);
+	bands.colorLUT = lut;
+	bands.colorPixelBytes = layout.bytesPerPixel;
+	bands.data = data;
+	bands.stride = stride;
+	bands.transform = &transform;
+	bands.sourcePixelBytes = pixel_source_bytes(layout.source);
+	bands.destPixelBytes = layout.bytesPerPixel;
+	bands.rowFunc = get_pixel_converter(layout.source, layout.colors);
+	if (bands.rowFunc == NULL)
+		return B_NO_TRANSLATOR;
+
+	return write_row_bands(target, bands, pool, threads, state);
+}
+
+
+static status_t
+resample_slice(const row_bands &bands, int32 firstRow, int32 rowCount,
+	uint8 *dest, int32 slot)
+{
+	return bands.resampler->ResampleRows(bands.data, bands.stride, firstRow,
+		rowCount, dest, bands.rowBytes,
+		bands.scratch + slot * bands.scratchSize);
+}
+
+
+static status_t
+write_resampled_rows(BPositionIO *target, const uint8 *data, size_t stride,
+	int32 width, int32 height, int32 destWidth, int32 destHeight,
+	resample_filter filter, const color_lut *lut, WorkerPool &pool,
+	int32 threads, DecodeState &state)
+{
+	Resampler resampler(width, height, destWidth, destHeight, filter);
+	if (resampler.InitCheck() != B_OK)
+		return resampler.InitCheck();
+
+	row_bands bands;
+	init_row_bands(bands, &resample_slice, destHeight, destWidth * 4,
+		destWidth * 4, pool, threads);
+	bands.colorLUT = lut;
+	bands.colorPixelBytes = 4;
+	bands.data = data;
+	bands.stride = stride;
+	bands.resampler = &resampler;
+	bands.scratchSize = resampler.ScratchSize(bands.sliceRows);
+	bands.scratch = new(std::nothrow) uint8[bands.slices * bands.scratchSize];
+	if (bands.scratch == NULL)
+		return B_NO_MEMORY;
+
+	status_t status = write_row_bands(target, bands, pool, threads, state);
+
+	delete[] bands.scratch;
+	return status;
+}
+
+
+// Fills in the planes of an image decoded in its native colour space.
+// Decoding an image only to find its planes of no use costs a second
+// decode, so deeper images are not tried at all
+static bool
+has_8bit_planes(const heif_image_handle *handle)
+{
+	return heif_image_handle_get_luma_bits_per_pixel(handle) == 8
+		&& heif_image_handle_get_chroma_bits_per_pixel(handle) <= 8;
+}
+
+
+// Anything but 8 bit Y'CbCr, or monochrome if allowed, is left to
+// libheif's own conversion.
+static bool
+get_ycbcr_planes(const heif_image *image, ycbcr_planes &planes,
+	bool allowMonochrome = false)
+{
+	int stride;
+	heif_colorspace space = heif_image_get_colorspace(image);
+	if (space == heif_colorspace_monochrome && allowMonochrome) {
+		planes.cb = planes.cr = NULL;
+		planes.cbStride = planes.crStride = 0;
+		planes.chromaShiftX = planes.chromaShiftY = 0;
+	} else if (space != heif_colorspace_YCbCr)
+		return false;
+
+	switch (space == heif_colorspace_YCbCr
+			? heif_image_get_chroma_format(image) : heif_chroma_monochrome) {
+		case heif_chroma_monochrome:
+			break;
+		case heif_chroma_420:
+			planes.chromaShiftX = 1;
+			planes.chromaShiftY = 1;
+			break;
+		case heif_chroma_422:
+			planes.chromaShiftX = 1;
+			planes.chromaShiftY = 0;
+			break;
+		case heif_chroma_444:
+			planes.chromaShiftX = 0;
+			planes.chromaShiftY = 0;
+			break;
+		default:
+			return false;
+	}
+
+	if (heif_image_get_bits_per_pixel_range(image, heif_channel_Y) != 8)
+		return false;
+
+	planes.y = heif_image_get_plane_readonly(image, heif_channel_Y, &stride);
+	planes.yStride = stride;
+
+	if (space == heif_colorspace_YCbCr) {
+		if (heif_image_get_bits_per_pixel_range(image, heif_channel_Cb) != 8
+			|| heif_image_get_bits_per_pixel_range(image, heif_channel_Cr)
+				!= 8)
+			return false;
+
+		planes.cb = heif_image_get_plane_readonly(image, heif_channel_Cb,
+			&stride);
+		planes.cbStride = stride;
+		planes.cr = heif_image_get_plane_readonly(image, heif_channel_Cr,
+			&stride);
+		planes.crStride = stride;
+		if (planes.cb == NULL || planes.cr == NULL)
+			return false;
+	}
+
+	planes.alpha = NULL;
+	planes.alphaStride = 0;
+	if (heif_image_has_channel(image, heif_channel_Alpha)) {
+		if (heif_image_get_bits_per_pixel_range(image,
+				heif_channel_Alpha) != 8)
+			return false;
+
+		planes.alpha = heif_image_get_plane_readonly(image,
+			heif_channel_Alpha, &stride);
+		planes.alphaStride = stride;
+		if (planes.alpha == NULL)
+			return false;
+	}
+
+	planes.width = heif_image_get_width(image, heif_channel_Y);
+	planes.height = heif_image_get_height(image, heif_channel_Y);
+
+	return planes.y != NULL;
+}
+
+
+// Picks the matrix from the nclx profile of the image, or of the handle
+// when the decoder did not attach one. Without any, libheif assumes full
+// range BT.601 and so do we.
+static bool
+get_ycbcr_coefficients(const heif_image_handle *handle,
+	const heif_image *image, ycbcr_coefficients &coefficients)
+{
+	heif_color_profile_nclx *nclx = NULL;
+	if (image == NULL
+		|| heif_image_get_nclx_color_profile(image, &nclx).code
+			!= heif_error_Ok) {
+		nclx = NULL;
+		if (heif_image_handle_get_nclx_color_profile(handle, &nclx).code
+				!= heif_error_Ok)
+			nclx = NULL;
+	}
+
+	double kr = 0.299;
+	double kb = 0.114;
+	bool fullRange = true;
+	bool supported = true;
+	if (nclx != NULL) {
+		switch (nclx->matrix_coefficients) {
+			case heif_matrix_coefficients_ITU_R_BT_709_5:
+				kr = 0.2126;
+				kb = 0.0722;
+				break;
+			case heif_matrix_coefficients_US_FCC_T47:
+				kr = 0.30;
+				kb = 0.11;
+				break;
+			case heif_matrix_coefficients_unspecified:
+			case heif_matrix_coefficients_ITU_R_BT_470_6_System_B_G:
+			case heif_matrix_coefficients_ITU_R_BT_601_6:
+				break;
+			case heif_matrix_coefficients_SMPTE_240M:
+				kr = 0.212;
+				kb = 0.087;
+				break;
+			case heif_matrix_coefficients_ITU_R_BT_2020_2_non_constant_luminance:
+				kr = 0.2627;
+				kb = 0.0593;
+				break;
+			default:
+				// RGB, YCgCo, constant luminance and ICtCp need more
+				// than a matrix
+				supported = false;
+				break;
+		}
+		fullRange = nclx->full_range_flag != 0;
+		heif_nclx_color_profile_free(nclx);
+	}
+
+	if (supported)
+		compute_ycbcr_coefficients(kr, kb, fullRange, coefficients);
+
+	return supported;
+}
+
+
+static status_t
+convert_ycbcr_slice(const row_bands &bands, int32 firstRow, int32 rowCount,
+	uint8 *dest, int32 /*slot*/)
+{
+	ycbcr_to_bgra(*bands.planes, *bands.coefficients, firstRow, rowCount,
+		dest, bands.rowBytes);
+	return B_OK;
+}
+
+
+static status_t
+write_ycbcr_rows(BPositionIO *target, const ycbcr_planes &planes,
+	const ycbcr_coefficients &coefficients, const color_lut *lut,
+	WorkerPool &pool, int32 threads, DecodeState &state)
+{
+	row_bands bands;
+	init_row_bands(bands, &convert_ycbcr_slice, planes.height,
+		planes.width * 4, planes.width * 4, pool, threads);
+	bands.colorLUT = lut;
+	bands.colorPixelBytes = 4;
+	bands.planes = &planes;
+	bands.coefficients = &coefficients;
+
+	return write_row_bands(target, bands, pool, threads, state);
+}
+
+
+static status_t
+pack_ycbcr_slice(const row_bands &bands, int32 firstRow, int32 rowCount,
+	uint8 *dest, int32 /*slot*/)
+{
+	pack_ycbcr(*bands.planes, bands.colors, firstRow, rowCount, dest,
+		bands.rowBytes);
+	return B_OK;
+}
+
+
+// Writes B_YCbCr422 or B_YCbCr420 straight from the decoded planes.
+// Only images that are not 8 bit Y'CbCr to begin with are converted by
+// libheif first.
+static status_t
+write_packed_ycbcr(BPositionIO *target, const heif_image_handle *handle,
+	int32 width, int32 height, color_space colors, bool dataOnly,
+	WorkerPool &pool, int32 threads, DecodeState &state)
+{
+	heif_decoding_options *options = state.Options();
+	heif_image *image = NULL;
+	heif_error error;
+	ycbcr_planes planes;
+	bool native = false;
+	if (has_8bit_planes(handle)) {
+		error = heif_decode_image(handle, &image, heif_colorspace_undefined,
+			heif_chroma_undefined, options);
+		if (error.code != heif_error_Ok)
+			return B_ERROR;
+
+		native = get_ycbcr_planes(image, planes, true);
+		if (!native)
+			heif_image_release(image);
+	}
+
+	if (!native) {
+		// The options are pooled, so put back what we change
+		options->convert_hdr_to_8bit = true;
+		error = heif_decode_image(handle, &image, heif_colorspace_YCbCr,
+			colors == B_YCbCr422 ? heif_chroma_422 : heif_chroma_420,
+			options);
+		options->convert_hdr_to_8bit = false;
+		if (error.code != heif_error_Ok)
+			return B_ERROR;
+
+		if (!get_ycbcr_planes(image, planes, true)) {
+			heif_image_release(image);
+			return B_ERROR;
+		}
+	}
+
+	if (planes.width < width || planes.height < height) {
+		heif_image_release(image);
+		return B_ERROR;
+	}
+	planes.width = width;
+	planes.height = height;
+
+	uint32 rowBytes = packed_ycbcr_row_bytes(colors, width);
+	status_t status = B_OK;
+	if (!dataOnly)
+		status = write_bitmap_header(target, width, height, rowBytes, colors);
+
+	if (status == B_OK) {
+		// pack_ycbcr() clears the padding itself
+		row_bands bands;
+		init_row_bands(bands, &pack_ycbcr_slice, height, rowBytes, rowBytes,
+			pool, threads);
+		bands.planes = &planes;
+		bands.colors = colors;
+		status = write_row_bands(target, bands, pool, threads, state);
+	}
+
+	heif_image_release(image);
+	return status;
+}
+
+
+#if LIBHEIF_HAVE_VERSION(1, 18, 0)
+
+// A band of grid tile rows that is decoded in parallel, one tile per
+// worker pool index, and converted straight into the output rows. Only
+// the tile columns that the output covers are decoded.
+struct tile_band {
+	const heif_image_handle	*handle;
+	BLocker					*readLock;
+		// held while decoding if libheif reads through a PositionIOReader
+	const heif_image_tiling	*tiling;
+	const heif_decoding_options *options;
+	const output_layout		*layout;
+	convert_rows_func		convert;
+	const ycbcr_coefficients *coefficients;
+		// set to convert the native Y'CbCr tiles ourselves
+	const color_lut			*colorLUT;
+	int32					left;
+	int32					top;
+		// of the region, where the output image starts
+	uint32					firstColumn;
+	uint32					columns;
+	uint32					firstTileRow;
+	uint8					*rows;
+	size_t					rowBytes;
+};
+
+
+static bool
+get_grid_tiling(const heif_image_handle *handle, bool applyTransforms,
+	int32 width, int32 height, heif_image_tiling &tiling)
+{
+	heif_error error = heif_image_handle_get_image_tiling(handle,
+		applyTransforms, &tiling);
+	if (error.code != heif_error_Ok)
+		return false;
+
+	return tiling.num_columns * tiling.num_rows > 1
+		&& tiling.top_offset == 0 && tiling.left_offset == 0
+		&& (int32)tiling.image_width == width
+		&& (int32)tiling.image_height == height;
+}
+
+
+// Follows the clap, irot and imir properties of the item in the order
+// they are listed. Returns false for anything we cannot follow, and
+// when the result does not match the size libheif gives the handle.
+static bool
+get_item_transform(heif_context *ctx, const heif_image_handle *handle,
+	image_transform &transform)
+{
+	heif_item_id id = heif_image_handle_get_item_id(handle);
+	init_image_transform(transform, heif_image_handle_get_ispe_width(handle),
+		heif_image_handle_get_ispe_height(handle));
+
+	heif_property_id properties[8];
+	int count = heif_item_get_transformation_properties(ctx, id, properties,
+		8);
+	if (count >= 8)
+		return false;
+
+	for (int i = 0; i < count; i++) {
+		switch (heif_item_get_property_type(ctx, id, properties[i])) {
+			case heif_item_property_type_transform_rotation:
+			{
+				int degrees = heif_item_get_property_transform_rotation_ccw(
+					ctx, id, properties[i]);
+				if (degrees < 0 || !transform_rotate_ccw(transform, degrees))
+					return false;
+				break;
+			}
+			case heif_item_property_type_transform_mirror:
+			{
+				// libheif's horizontal mirror flips each row
+				heif_transform_mirror_direction direction
+					= heif_item_get_property_transform_mirror(ctx, id,
+						properties[i]);
+				if (direction == heif_transform_mirror_direction_invalid)
+					return false;
+				transform_mirror(transform,
+					direction == heif_transform_mirror_direction_horizontal);
+				break;
+			}
+			case heif_item_property_type_transform_crop:
+			{
+				int left, top, right, bottom;
+				heif_item_get_property_transform_crop_borders(ctx, id,
+					properties[i], transform.width, transform.height, &left,
+					&top, &right, &bottom);
+				if (!transform_crop(transform, left, top,
+						transform.width - left - right,
+						transform.height - top - bottom))
+					return false;
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+
+	return transform.width == heif_image_handle_get_width(handle)
+		&& transform.height == heif_image_handle_get_height(handle);
+}
+
+
+static status_t
+decode_tile(void *data, int32 index)
+{
+	tile_band *band = (tile_band *)data;
+	const heif_image_tiling *tiling = band->tiling;
+	uint32 column = band->firstColumn + index % band->columns;
+	uint32 row = band->firstTileRow + index / band->columns;
+
+	// A stream read through a PositionIOReader has one position for all
+	// threads, so the tiles are decoded one at a time; converting them
+	// still runs in parallel
+	if (band->readLock != NULL)
+		band->readLock->Lock();
+
+	heif_image *tile = NULL;
+	ycbcr_planes planes;
+	bool native = false;
+	heif_error error = { heif_error_Ok };
+	if (band->coefficients != NULL) {
+		error = heif_image_handle_decode_image_tile(band->handle, &tile,
+			heif_colorspace_undefined, heif_chroma_undefined, band->options,
+			column, row);
+		native = error.code == heif_error_Ok && get_ycbcr_planes(tile, planes);
+		if (error.code == heif_error_Ok && !native)
+			heif_image_release(tile);
+	}
+
+	const output_layout *layout = band->layout;
+	if (error.code == heif_error_Ok && !native) {
+		error = heif_image_handle_decode_image_tile(band->handle, &tile,
+			layout->space, layout->chroma, band->options, column, row);
+	}
+
+	if (band->readLock != NULL)
+		band->readLock->Unlock();
+	if (error.code != heif_error_Ok)
+		return B_ERROR;
+
+	// Tiles in the last row and column may reach past the image edge
+	heif_channel channel = native ? heif_channel_Y : layout->channel;
+	int32 x = column * tiling->tile_width;
+	int32 y = row * tiling->tile_height;
+	int32 width = min_c(heif_image_get_width(tile, channel),
+		(int32)tiling->image_width - x);
+	int32 height = min_c(heif_image_get_height(tile, channel),
+		(int32)tiling->image_height - y);
+	uint8 *dest = band->rows
+		+ (y - band->firstTileRow * tiling->tile_height) * band->rowBytes
+		+ (x - band->firstColumn * tiling->tile_width) * layout->bytesPerPixel;
+
+	const uint8 *pixels;
+	if (native) {
+		planes.width = width;
+		planes.height = height;
+		ycbcr_to_bgra(planes, *band->coefficients, 0, height, dest,
+			band->rowBytes);
+		pixels = planes.y;
+	} else {
+		int stride;
+		pixels = heif_image_get_plane_readonly(tile, layout->channel,
+			&stride);
+		if (pixels != NULL) {
+			band->convert(pixels, stride, dest, band->rowBytes, width, height,
+				x - band->left, y - band->top);
+		}
+	}
+
+	if (pixels != NULL && band->colorLUT != NULL) {
+		apply_color_lut(*band->colorLUT, dest, band->rowBytes, width, height,
+			layout->bytesPerPixel);
+	}
+
+	heif_image_release(tile);
+	return pixels != NULL ? B_OK : B_ERROR;
+}
+
+
+// Writes the region of the image, decoding only the tiles it touches
+static status_t
+write_tiled_rows(BPositionIO *target, const heif_image_handle *handle,
+	BLocker *readLock, const heif_image_tiling &tiling,
+	const clipping_rect &region, const output_layout &layout,
+	const ycbcr_coefficients *coefficients, const color_lut *lut,
+	WorkerPool &pool, int32 threads, DecodeState &state)
+{
+	uint32 firstColumn = region.left / tiling.tile_width;
+	uint32 columns = region.right / tiling.tile_width - firstColumn + 1;
+	uint32 firstTileRow = region.top / tiling.tile_height;
+	uint32 lastTileRow = region.bottom / tiling.tile_height;
+
+	// Decode enough tile rows at once to give every thread a tile
+	threads = min_c(threads, pool.CountThreads() + 1);
+	uint32 tileRows = (threads + columns - 1) / columns;
+	tileRows = min_c(tileRows, lastTileRow - firstTileRow + 1);
+
+	convert_rows_func convert = get_pixel_converter(layout.source,
+		layout.colors);
+	if (convert == NULL)
+		return B_NO_TRANSLATOR;
+
+	// The band holds whole tiles; when the region is narrower than them
+	// its rows are copied out one at a time
+	int32 bandLeft = firstColumn * tiling.tile_width;
+	int32 bandWidth = min_c(columns * tiling.tile_width,
+		tiling.image_width - bandLeft);
+	int32 width = region.right - region.left + 1;
+	size_t rowBytes = output_row_bytes(layout, width);
+	size_t bandRowBytes = output_row_bytes(layout, bandWidth);
+	bool wholeRows = bandLeft == region.left && bandWidth == width;
+
+	size_t bandSize = tileRows * tiling.tile_height * bandRowBytes;
+	uint8 *rows = state.Band(bandSize + (wholeRows ? 0 : rowBytes));
+	if (rows == NULL)
+		return B_NO_MEMORY;
+	if (bandRowBytes != bandWidth * layout.bytesPerPixel)
+		memset(rows, 0, bandSize);
+
+	uint8 *line = rows + bandSize;
+	if (!wholeRows)
+		memset(line, 0, rowBytes);
+
+	tile_band band;
+	band.handle = handle;
+	band.readLock = readLock;
+	band.tiling = &tiling;
+	band.options = state.Options();
+	band.layout = &layout;
+	band.convert = convert;
+	band.coefficients = coefficients;
+	band.colorLUT = lut;
+	band.left = region.left;
+	band.top = region.top;
+	band.firstColumn = firstColumn;
+	band.columns = columns;
+	band.rows = rows;
+	band.rowBytes = bandRowBytes;
+
+	status_t status = B_OK;
+	for (uint32 row = firstTileRow; row <= lastTileRow; row += tileRows) {
+		uint32 count = min_c(tileRows, lastTileRow - row + 1);
+		band.firstTileRow = row;
+
+		status = pool.Run(&decode_tile, &band, count * columns, threads);
+		if (status != B_OK)
+			break;
+
+		int32 bandTop = row * tiling.tile_height;
+		int32 first = max_c(bandTop, region.top);
+		int32 last = min_c(bandTop + (int32)(count * tiling.tile_height),
+			region.bottom + 1);
+		const uint8 *source = rows + (first - bandTop) * bandRowBytes
+			+ (region.left - bandLeft) * layout.bytesPerPixel;
+
+		if (wholeRows) {
+			ssize_t bytes = (last - first) * rowBytes;
+			if (target->Write(source, bytes) != bytes)
+				status = B_ERROR;
+		} else {
+			for (int32 y = first; y < last && status == B_OK; y++) {
+				memcpy(line, source, width * layout.bytesPerPixel);
+				if (target->Write(line, rowBytes) != (ssize_t)rowBytes)
+					status = B_ERROR;
+				source += bandRowBytes;
+			}
+		}
+		if (status != B_OK)
+			break;
+	}
+
+	return status;
+}
+
+#endif // LIBHEIF_HAVE_VERSION(1, 18, 0)
+
+
+// Returns the smallest embedded thumbnail whose longer side is still at
+// least maxSize pixels, or NULL if only the primary image will do.
+static heif_image_handle *
+find_thumbnail(const heif_image_handle *primary, int32 maxSize)
+{
+	int count = heif_image_handle_get_number_of_thumbnails(primary);
+	if (maxSize <= 0 || count <= 0)
+		return NULL;
+
+	heif_item_id *ids = new(std::nothrow) heif_item_id[count];
+	if (ids == NULL)
+		return NULL;
+	count = heif_image_handle_get_list_of_thumbnail_IDs(primary, ids, count);
+
+	heif_image_handle *best = NULL;
+	int bestSize = 0;
+	for (int i = 0; i < count; i++) {
+		heif_image_handle *thumbnail;
+		heif_error error = heif_image_handle_get_thumbnail(primary, ids[i],
+			&thumbnail);
+		if (error.code != heif_error_Ok)
+			continue;
+
+		int size = max_c(heif_image_handle_get_width(thumbnail),
+			heif_image_handle_get_height(thumbnail));
+		if (size >= maxSize && (best == NULL || size < bestSize)) {
+			if (best != NULL)
+				heif_image_handle_release(best);
+			best = thumbnail;
+			bestSize = size;
+		} else
+			heif_image_handle_release(thumbnail);
+	}
+
+	delete[] ids;
+	return best;
+}
+
+
 HEICTranslator::HEICTranslator()
 		: BaseTranslator(B_TRANSLATE("HEIC images"),
 				B_TRANSLATE("HEIC image translator"),
@@ -86,7 +1096,7 @@ status_t
 HEICTranslator::DerivedIdentify(
 	BPositionIO *inSource,
 	const translation_format *inFormat,
-	BMessage * /*ioExtension*/,
+	BMessage *ioExtension,
 	translator_info *outInfo,
 	uint32 outType)
 {
@@ -94,26 +1104,44 @@ HEICTranslator::DerivedIdentify(
 	if (outType && (outType != B_TRANSLATOR_BITMAP))
 		return B_NO_TRANSLATOR;
 
-	// Check for HEIC magic bytes
-	char magic[12];
-	ssize_t readSize = inSource->Read(magic, 12);
-	if (readSize < 12)
+	// Files that were identified before and have not changed since are
+	// answered from the cache, whether they were HEIF or not
+	file_identity identity;
+	bool cached = _GetBoolSetting(ioExtension, HEIC_SETTING_IDENTIFY_CACHE)
+		&& get_file_identity(inSource, identity);
+	uint32 brands;
+	if (!cached || !fIdentifyCache.Lookup(identity, brands)) {
+		// Identify runs for every file a file manager looks at, so only
+		// the ftyp box is read, and the brands it lists decide; the same
+		// brands as in the sniff rule of HEICMime.rdef are taken
+		uint8 header[kFileTypeHeaderSize];
+		ssize_t readSize = inSource->Read(header, sizeof(header));
+		if (readSize < 0)
+			return B_NO_TRANSLATOR;
+
+		brands = readSize < 16 ? 0 : read_ftyp_brands(header, readSize);
+		if (cached)
+			fIdentifyCache.Add(identity, brands);
+	}
+
+	float quality = 1;
+	float capability = 1;
+	heif_file_format format;
+	if (!brands_match(brands, quality, capability, format))
 		return B_NO_TRANSLATOR;
 
-	// HEIC files start with ftypheic or ftyphevc
-	if (memcmp(magic + 4, "ftypheic", 8) == 0 || memcmp(magic + 4, "ftyphevc", 8) == 0) {
-		inFormat = &sInputFormats[0];
-		outInfo->type = inFormat->type;
-		outInfo->group = inFormat->group;
-		outInfo->quality = inFormat->quality;
-		outInfo->capability = inFormat->capability;
-		strcpy(outInfo->name, inFormat->name);
-		strcpy(outInfo->MIME, inFormat->MIME);
+	inFormat = &sInputFormats[format];
+	quality *= inFormat->quality;
+	capability *= inFormat->capability;
 
-		return B_OK;
-	}
+	outInfo->type = inFormat->type;
+	outInfo->group = inFormat->group;
+	outInfo->quality = quality;
+	outInfo->capability = capability;
+	strcpy(outInfo->name, inFormat->name);
+	strcpy(outInfo->MIME, inFormat->MIME);
 
-	return B_NO_TRANSLATOR;
+	return B_OK;
 }
 
 
@@ -121,14 +1149,17 @@ status_t
 HEICTranslator::DerivedTranslate (
 	BPositionIO *source,
 	const translator_info *info,
-	BMessage * /*ioExtension*/,
+	BMessage *ioExtension,
 	uint32 outType,
 	BPositionIO *target, int32 baseType)
 {
 	status_t ret_val = B_OK;
 
 	//	Check that we handle input and output types
-	if (info->type != HEIC_IMAGE_FORMAT)
+	bool known = false;
+	for (uint32 i = 0; i < kNumInputFormats; i++)
+		known |= info->type == sInputFormats[i].type;
+	if (!known)
 		return B_NO_TRANSLATOR;
 
 	if (outType == 0)
@@ -137,89 +1168,534 @@ HEICTranslator::DerivedTranslate (
 	if (outType != B_TRANSLATOR_BITMAP)
 		return B_NO_TRANSLATOR;
 
-	// Read input into memory
-	size_t fileSize = source->Seek(0, SEEK_END);
-	source->Seek(0, SEEK_SET);
-	uint8_t *buffer = new uint8_t[fileSize];
-	if (source->Read(buffer, fileSize) != fileSize)
-	{
-		delete[] buffer;
-		return B_ERROR;
+	file_identity identity;
+	bool hasIdentity = get_file_identity(source, identity);
+
+	// Applications ask for the header first to learn the size of the
+	// image; for a file translated before it is written from what was
+	// kept of the primary image. Thumbnails are only looked for once the
+	// file is parsed.
+	bool identifyCached = hasIdentity
+		&& _GetBoolSetting(ioExtension, HEIC_SETTING_IDENTIFY_CACHE);
+	image_metadata metadata;
+	if (identifyCached
+		&& _GetBoolSetting(ioExtension, B_TRANSLATOR_EXT_HEADER_ONLY)
+		&& get_int32_option(ioExtension, HEIC_SETTING_MAX_SIZE) <= 0
+		&& fIdentifyCache.LookupMetadata(identity, metadata)) {
+		DecodeState *state = fDecodeStates.Acquire();
+		if (state == NULL)
+			return B_NO_MEMORY;
+
+		ret_val = _WriteImage(NULL, NULL, NULL, metadata, NULL, ioExtension,
+			target, *state);
+		fDecodeStates.Release(state);
+		return ret_val;
+	}
+
+	// Images translated before in this process are written from memory;
+	// requests for an image that is being translated wait for it. Data
+	// only translations lack the header that gives their size, so they
+	// are not kept. The budget is always the saved one, so that a request
+	// cannot evict what was kept for others; it can only leave the cache
+	// out by giving 0.
+	fBitmaps.SetBudget((size_t)max_c(fSettings->SetGetInt32(
+		HEIC_SAVED_SETTING(HEIC_SETTING_BITMAP_CACHE_SIZE)), 0) * 1024 * 1024);
+	bitmap_cache_key bitmapKey;
+	bool bitmapCached = hasIdentity
+		&& _GetInt32Setting(ioExtension, HEIC_SETTING_BITMAP_CACHE_SIZE) > 0
+		&& !_GetBoolSetting(ioExtension, B_TRANSLATOR_EXT_DATA_ONLY)
+		&& _OutputParameters(ioExtension, bitmapKey.parameters);
+	BitmapCacheWriter *bitmapWriter = NULL;
+	if (bitmapCached) {
+		bitmapKey.source = identity;
+		ret_val = fBitmaps.Write(bitmapKey, target);
+		if (ret_val != B_ENTRY_NOT_FOUND)
+			return ret_val;
+
+		bitmapWriter = new(std::nothrow) BitmapCacheWriter(target, fBitmaps,
+			bitmapKey);
+		if (bitmapWriter != NULL)
+			target = bitmapWriter;
+	}
+
+	// Files translated a moment ago are still parsed
+	bool cached = _GetBoolSetting(ioExtension, HEIC_SETTING_CONTEXT_CACHE)
+		&& hasIdentity;
+	HEICInput *input = NULL;
+	heif_context* ctx = NULL;
+	if (cached)
+		ctx = fContexts.Acquire(identity, input);
+
+	bool parsed = ctx != NULL;
+	if (ctx == NULL) {
+		// Map or read the input, then load the HEIC image from memory
+		input = new(std::nothrow) HEICInput(source);
+		ctx = heif_context_alloc();
+		if (input == NULL || ctx == NULL) {
+			delete input;
+			heif_context_free(ctx);
+			input = NULL;
+			ctx = NULL;
+			cached = false;
+		}
+	}
+
+	// Images decoded before, by this process or another, are served
+	// from disk without even parsing them
+	BPath diskCacheDirectory;
+	uint64 diskCacheKey;
+	off_t diskCacheBudget = (off_t)_GetInt32Setting(ioExtension,
+		HEIC_SETTING_DISK_CACHE_SIZE) * 1024 * 1024;
+	bool diskCached = input != NULL && _DiskCacheKey(ioExtension, input,
+		diskCacheDirectory, diskCacheKey);
+	ret_val = input != NULL ? B_ENTRY_NOT_FOUND : B_NO_MEMORY;
+	if (diskCached) {
+		ret_val = fDiskCache.Write(diskCacheDirectory.Path(), diskCacheKey,
+			target);
+	}
+
+	if (ret_val == B_ENTRY_NOT_FOUND) {
+		ret_val = parsed ? B_OK : input->ReadInto(ctx);
+		parsed = ret_val == B_OK;
+
+		if (parsed) {
+			heif_context_set_max_decoding_threads(ctx,
+				_DecoderThreads(ioExtension));
+
+			BPositionIO *output = target;
+			DiskCacheWriter *writer = NULL;
+			if (diskCached) {
+				writer = new(std::nothrow) DiskCacheWriter(target,
+					diskCacheDirectory.Path(), diskCacheKey, diskCacheBudget);
+				if (writer != NULL)
+					output = writer;
+			}
+
+			DecodeState *state = fDecodeStates.Acquire();
+			image_metadata primary;
+			if (state != NULL) {
+				ret_val = _TranslateImage(ctx, input->ReadLock(),
+					ioExtension, output, *state, primary);
+				fDecodeStates.Release(state);
+			} else
+				ret_val = B_NO_MEMORY;
+
+			if (ret_val == B_OK && identifyCached)
+				fIdentifyCache.AddMetadata(identity, primary);
+
+			if (writer != NULL) {
+				if (ret_val == B_OK) {
+					fDiskCache.Publish(*writer, diskCacheDirectory.Path(),
+						diskCacheBudget);
+				}
+				delete writer;
+			}
+		}
+	}
+
+	if (cached && parsed)
+		fContexts.Release(identity, ctx, input);
+	else {
+		heif_context_free(ctx);
+		delete input;
 	}
 
-	// Load HEIC image from memory
-	heif_context* ctx = heif_context_alloc();
-	heif_context_read_from_memory_without_copy(ctx, buffer, fileSize, nullptr);
+	if (bitmapCached) {
+		if (ret_val == B_OK && bitmapWriter != NULL)
+			fBitmaps.Store(bitmapKey, *bitmapWriter);
+		else
+			fBitmaps.Abandon(bitmapKey);
+		delete bitmapWriter;
+	}
 
+	return ret_val;
+}
+
+
+status_t
+HEICTranslator::GetConfigurationMessage(BMessage *ioExtension)
+{
+	status_t status = BaseTranslator::GetConfigurationMessage(ioExtension);
+	if (status == B_OK) {
+		fDecodeStates.AddStatistics(ioExtension);
+		fColorLUTs.AddStatistics(ioExtension);
+		fIdentifyCache.AddStatistics(ioExtension);
+		fContexts.AddStatistics(ioExtension);
+		fDiskCache.AddStatistics(ioExtension);
+		fBitmaps.AddStatistics(ioExtension);
+	}
+
+	return status;
+}
+
+
+status_t
+HEICTranslator::_TranslateImage(heif_context *ctx, BLocker *readLock,
+	BMessage *ioExtension, BPositionIO *target, DecodeState &state,
+	image_metadata &primary)
+{
 	heif_image_handle* handle;
-	heif_context_get_primary_image_handle(ctx, &handle);
+	heif_error error = heif_context_get_primary_image_handle(ctx, &handle);
+	if (error.code != heif_error_Ok)
+		return B_NO_TRANSLATOR;
+
+	get_image_metadata(handle, primary);
+	image_metadata metadata = primary;
+
+	// Camera files carry a small thumbnail, which is all a caller that
+	// only needs a preview has to pay for; a region is given in pixels
+	// of the primary image though
+	int32 maxSize = get_int32_option(ioExtension, HEIC_SETTING_MAX_SIZE);
+	bool hasRegion = ioExtension != NULL
+		&& ioExtension->HasRect(HEIC_SETTING_REGION);
+	if (maxSize > 0 && !hasRegion
+		&& max_c(primary.width, primary.height) > maxSize) {
+		heif_image_handle *thumbnail = find_thumbnail(handle, maxSize);
+		if (thumbnail != NULL) {
+			heif_image_handle_release(handle);
+			handle = thumbnail;
+			get_image_metadata(handle, metadata);
+		}
+	}
+
+	// Images in wide gamut or other colour spaces are brought into sRGB,
+	// which is what the app_server assumes bitmaps are in
+	const color_lut *lut = NULL;
+	if (_GetBoolSetting(ioExtension, HEIC_SETTING_COLOR_MANAGEMENT))
+		lut = fColorLUTs.Acquire(handle);
+
+	// Viewers that need several sizes get them all from one decode
+	PyramidWriter *pyramid = NULL;
+	if (get_int32_option(ioExtension, HEIC_SETTING_PYRAMID_LEVELS) > 1
+		&& !_GetBoolSetting(ioExtension, B_TRANSLATOR_EXT_HEADER_ONLY)) {
+		pyramid = new(std::nothrow) PyramidWriter(target,
+			get_int32_option(ioExtension, HEIC_SETTING_PYRAMID_LEVELS));
+		if (pyramid == NULL) {
+			fColorLUTs.Release(lut);
+			heif_image_handle_release(handle);
+			return B_NO_MEMORY;
+		}
+		target = pyramid;
+	}
+
+	status_t status = _WriteImage(ctx, readLock, handle, metadata, lut,
+		ioExtension, target, state);
+	if (pyramid != NULL) {
+		if (status == B_OK)
+			status = pyramid->Finish(ioExtension);
+		delete pyramid;
+	}
+
+	fColorLUTs.Release(lut);
+	heif_image_handle_release(handle);
+	return status;
+}
+
+
+status_t
+HEICTranslator::_WriteImage(heif_context *ctx, BLocker *readLock,
+	heif_image_handle *handle, const image_metadata &metadata,
+	const color_lut *lut, BMessage *ioExtension, BPositionIO *target,
+	DecodeState &state)
+{
+	status_t ret_val = B_OK;
+
+	// Without irot, imir and clap applied the image is written as coded;
+	// the options are pooled, so this is set for every image
+	bool applyTransforms = _GetBoolSetting(ioExtension,
+		HEIC_SETTING_APPLY_TRANSFORMS);
+	heif_decoding_options *options = state.Options();
+	options->ignore_transformations = !applyTransforms;
+
+	int32 imageWidth = applyTransforms ? metadata.width : metadata.ispeWidth;
+	int32 imageHeight = applyTransforms ? metadata.height
+		: metadata.ispeHeight;
+
+	// Viewers zoomed into a large image only need the part on screen
+	clipping_rect region = { 0, 0, imageWidth - 1, imageHeight - 1 };
+	BRect requestedRegion;
+	bool hasRegion = ioExtension != NULL && ioExtension->FindRect(
+		HEIC_SETTING_REGION, &requestedRegion) == B_OK;
+	if (hasRegion) {
+		region.left = max_c(region.left, (int32)requestedRegion.left);
+		region.top = max_c(region.top, (int32)requestedRegion.top);
+		region.right = min_c(region.right, (int32)requestedRegion.right);
+		region.bottom = min_c(region.bottom, (int32)requestedRegion.bottom);
+		if (region.left > region.right || region.top > region.bottom)
+			return B_BAD_VALUE;
+	}
+	int32 regionWidth = region.right - region.left + 1;
+	int32 regionHeight = region.bottom - region.top + 1;
+
+	// Whatever is still larger than requested is scaled down while it
+	// is converted
+	int32 maxSize = get_int32_option(ioExtension, HEIC_SETTING_MAX_SIZE);
+	int32 outWidth = regionWidth;
+	int32 outHeight = regionHeight;
+	if (maxSize > 0 && max_c(outWidth, outHeight) > maxSize)
+		Resampler::FitSize(outWidth, outHeight, maxSize, outWidth, outHeight);
+
+	bool headerOnly = _GetBoolSetting(ioExtension,
+		B_TRANSLATOR_EXT_HEADER_ONLY);
+	// The levels of a pyramid are told apart by their headers
+	bool dataOnly = _GetBoolSetting(ioExtension, B_TRANSLATOR_EXT_DATA_ONLY)
+		&& get_int32_option(ioExtension, HEIC_SETTING_PYRAMID_LEVELS) <= 1;
+	bool scaled = outWidth != regionWidth || outHeight != regionHeight;
+	bool convertYCbCr = _GetBoolSetting(ioExtension,
+		HEIC_SETTING_CONVERT_YCBCR);
+
+	// Overlay and video consumers can take the decoder's planes as they
+	// are, everyone else gets the smallest RGB or gray output that fits
+	color_space requested = (color_space)get_int32_option(ioExtension,
+		HEIC_SETTING_COLOR_SPACE, B_NO_COLOR_SPACE);
+	bool packYCbCr = (requested == B_YCbCr422 || requested == B_YCbCr420)
+		&& !scaled && !hasRegion;
+	output_layout layout = choose_output_layout(metadata, requested, scaled);
+	if (!scaled && _GetBoolSetting(ioExtension, HEIC_SETTING_HIGH_BIT_DEPTH))
+		use_high_bit_depth(metadata, layout);
+	uint32 rowBytes = output_row_bytes(layout, outWidth);
+
+	// The image sizes with and without its transforms are all the header
+	// needs, so it is written from the metadata alone
+	if (headerOnly) {
+		if (packYCbCr) {
+			return write_bitmap_header(target, outWidth, outHeight,
+				packed_ycbcr_row_bytes(requested, outWidth), requested);
+		}
+		return write_bitmap_header(target, outWidth, outHeight, rowBytes,
+			layout.colors);
+	}
+
+	int32 threads = _DecoderThreads(ioExtension);
+	if (packYCbCr) {
+		return write_packed_ycbcr(target, handle, outWidth, outHeight,
+			requested, dataOnly, fWorkerPool, threads, state);
+	}
+
+	// The fused Y'CbCr converter reads 8 bit planes and writes four
+	// byte pixels only
+	if (layout.bytesPerPixel != 4 || pixel_source_bytes(layout.source) > 4)
+		convertYCbCr = false;
+
+	// The colour tables are for 8 bit RGB, gray has no gamut to convert
+	if (layout.colors == B_GRAY8 || layout.colors == B_RGBA64)
+		lut = NULL;
+
+#if LIBHEIF_HAVE_VERSION(1, 18, 0)
+	// Grid images are decoded tile by tile on the worker pool, so all
+	// cores are busy and only a band of tiles is ever held in memory;
+	// tiles outside the region are not decoded at all
+	heif_image_tiling tiling;
+	if (!scaled && get_grid_tiling(handle, applyTransforms, imageWidth,
+			imageHeight, tiling)) {
+		ycbcr_coefficients coefficients;
+		bool native = convertYCbCr && has_8bit_planes(handle)
+			&& get_ycbcr_coefficients(handle, NULL, coefficients);
+
+		if (!dataOnly)
+			ret_val = write_bitmap_header(target, outWidth, outHeight,
+				rowBytes, layout.colors);
+		if (ret_val == B_OK)
+			ret_val = write_tiled_rows(target, handle, readLock, tiling,
+				region, layout, native ? &coefficients : NULL, lut,
+				fWorkerPool, threads, state);
+
+		return ret_val;
+	}
+#endif
+
+	// Converting the decoder's own planes saves libheif's conversion
+	// pass over the whole image; scaling and regions still start from RGB
+	if (convertYCbCr && !scaled && !hasRegion && has_8bit_planes(handle)) {
+		heif_image *native;
+		heif_error error = heif_decode_image(handle, &native,
+			heif_colorspace_undefined, heif_chroma_undefined, state.Options());
+		if (error.code != heif_error_Ok)
+			return B_ERROR;
+
+		ycbcr_planes planes;
+		ycbcr_coefficients coefficients;
+		if (get_ycbcr_planes(native, planes)
+			&& get_ycbcr_coefficients(handle, native, coefficients)
+			&& planes.width >= outWidth && planes.height >= outHeight) {
+			planes.width = outWidth;
+			planes.height = outHeight;
+			if (!dataOnly)
+				ret_val = write_bitmap_header(target, outWidth, outHeight,
+					rowBytes, layout.colors);
+			if (ret_val == B_OK)
+				ret_val = write_ycbcr_rows(target, planes, coefficients, lut,
+					fWorkerPool, threads, state);
+
+			heif_image_release(native);
+			return ret_val;
+		}
+
+		heif_image_release(native);
+	}
+
+	// Rather than have libheif turn the image around in a pass of its
+	// own, we do it while converting
+	image_transform transform;
+	bool fuseTransform = false;
+#if LIBHEIF_HAVE_VERSION(1, 18, 0)
+	fuseTransform = applyTransforms && !scaled
+		&& get_item_transform(ctx, handle, transform)
+		&& !is_identity_transform(transform,
+			heif_image_handle_get_ispe_width(handle),
+			heif_image_handle_get_ispe_height(handle));
+#endif
 
+	// Opaque images are decoded without an alpha channel and monochrome
+	// ones as a single plane; the resampler wants RGBA
+	heif_channel channel = scaled ? heif_channel_interleaved : layout.channel;
 	heif_image* img;
-	heif_decode_image(handle, &img, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, nullptr);
+	options->ignore_transformations = !applyTransforms || fuseTransform;
+	heif_error error = heif_decode_image(handle, &img,
+		scaled ? heif_colorspace_RGB : layout.space,
+		scaled ? heif_chroma_interleaved_RGBA : layout.chroma, options);
+	options->ignore_transformations = !applyTransforms;
+	if (error.code != heif_error_Ok)
+		return B_ERROR;
 
 	int width = heif_image_get_primary_width(img);
 	int height = heif_image_get_primary_height(img);
 	int stride;
-	const uint8_t* data = heif_image_get_plane_readonly(img, heif_channel_interleaved, &stride);
-
-	// Create Haiku bitmap
-	BBitmap *bitmap = new BBitmap(BRect(0, 0, width-1, height-1), B_RGBA32);
-	if (!bitmap->IsValid())
-	{
+	const uint8_t* data = heif_image_get_plane_readonly(img, channel, &stride);
+	if (data == NULL || (fuseTransform
+			&& (width != heif_image_handle_get_ispe_width(handle)
+				|| height != heif_image_handle_get_ispe_height(handle)))
+		|| (!fuseTransform && (width <= region.right
+			|| height <= region.bottom))) {
 		heif_image_release(img);
-		heif_image_handle_release(handle);
-		heif_context_free(ctx);
-		delete[] buffer;
 		return B_ERROR;
 	}
 
-	uint8 *dest = (uint8_t *)bitmap->Bits();
+	// Only the region is converted, the decoded image is not copied
+	if (fuseTransform) {
+		transform_crop(transform, region.left, region.top, regionWidth,
+			regionHeight);
+	} else {
+		uint32 pixelBytes = scaled ? 4 : pixel_source_bytes(layout.source);
+		data += region.top * stride + region.left * pixelBytes;
+	}
 
-	// Convert BGRA to RGBA
-	const uint8 *src = data;
-	for (int y=0; y < height; y++)
-	{
-		for (int x=0; x<width; x++)
-		{
-			uint8 r=*src++;
-			uint8 g=*src++;
-			uint8 b=*src++;
-			uint8 a=*src++;
-			*dest++ = b;
-			*dest++ = g;
-			*dest++ = r;
-			*dest++ = a;
+	// Convert to the output layout and stream it out, libheif may pad
+	// its rows
+	if (!dataOnly)
+		ret_val = write_bitmap_header(target, outWidth, outHeight,
+			rowBytes, layout.colors);
+	if (ret_val == B_OK) {
+		if (scaled) {
+			ret_val = write_resampled_rows(target, data, stride, regionWidth,
+				regionHeight, outWidth, outHeight,
+				(resample_filter)get_int32_option(ioExtension,
+					HEIC_SETTING_SCALE_FILTER, RESAMPLE_BILINEAR),
+				lut, fWorkerPool, threads, state);
+		} else if (fuseTransform) {
+			ret_val = write_transformed_rows(target, data, stride, transform,
+				layout, lut, fWorkerPool, threads, state);
+		} else {
+			ret_val = write_rows(target, data, stride, regionWidth,
+				regionHeight, layout, lut, fWorkerPool, threads, state);
 		}
-		src += stride - (width *4);
 	}
 
 	heif_image_release(img);
-	heif_image_handle_release(handle);
-	heif_context_free(ctx);
-	delete[] buffer;
+	return ret_val;
+}
 
-	// Prepare TranslatorBitmap header
-	TranslatorBitmap bmp;
-	bmp.magic = B_TRANSLATOR_BITMAP;
-	bmp.bounds = bitmap->Bounds();
-	bmp.rowBytes = bitmap->BytesPerRow();
-	bmp.colors = B_RGBA32;
-	bmp.dataSize = bitmap->BitsLength();
 
-	// Convert header to correct endianness
-	swap_data(B_UINT32_TYPE, &(bmp.magic), sizeof(uint32), B_SWAP_BENDIAN_TO_HOST);
-	swap_data(B_RECT_TYPE, &(bmp.bounds), sizeof(BRect), B_SWAP_BENDIAN_TO_HOST);
-	swap_data(B_UINT32_TYPE, &(bmp.rowBytes), sizeof(uint32), B_SWAP_BENDIAN_TO_HOST);
-	swap_data(B_UINT32_TYPE, &(bmp.colors), sizeof(color_space), B_SWAP_BENDIAN_TO_HOST);
-	swap_data(B_UINT32_TYPE, &(bmp.dataSize), sizeof(uint32), B_SWAP_BENDIAN_TO_HOST);
+// A request's ioExtension overrides the saved settings for that request
+// alone, see RequestSettings.h
+bool
+HEICTranslator::_GetBoolSetting(BMessage *ioExtension, const char *name)
+{
+	return get_bool_setting(fSettings, ioExtension, name);
+}
 
-	// Write bitmap header & pixel data
-	if (target->Write(&bmp, sizeof(TranslatorBitmap)) != sizeof(TranslatorBitmap) || target->Write(bitmap->Bits(), bitmap->BitsLength()) != bitmap->BitsLength()) {
-		ret_val = B_ERROR;
-	}
 
-	delete bitmap;
-	return ret_val;
+int32
+HEICTranslator::_GetInt32Setting(BMessage *ioExtension, const char *name)
+{
+	return get_int32_setting(fSettings, ioExtension, name);
+}
+
+
+// Hashes every setting that changes what is written for an image; the
+// caches leave out header only requests, which are cheap as they are,
+// and pyramids, whose levels are reported in ioExtension
+bool
+HEICTranslator::_OutputParameters(BMessage *ioExtension, uint64 &hash)
+{
+	if (_GetBoolSetting(ioExtension, B_TRANSLATOR_EXT_HEADER_ONLY)
+		|| get_int32_option(ioExtension, HEIC_SETTING_PYRAMID_LEVELS) > 1)
+		return false;
+
+	BRect region(-1, -1, -1, -1);
+	if (ioExtension != NULL)
+		ioExtension->FindRect(HEIC_SETTING_REGION, &region);
+
+	int32 parameters[] = {
+		get_int32_option(ioExtension, HEIC_SETTING_MAX_SIZE),
+		get_int32_option(ioExtension, HEIC_SETTING_SCALE_FILTER,
+			RESAMPLE_BILINEAR),
+		get_int32_option(ioExtension, HEIC_SETTING_COLOR_SPACE,
+			B_NO_COLOR_SPACE),
+		_GetBoolSetting(ioExtension, HEIC_SETTING_CONVERT_YCBCR),
+		_GetBoolSetting(ioExtension, HEIC_SETTING_APPLY_TRANSFORMS),
+		_GetBoolSetting(ioExtension, HEIC_SETTING_COLOR_MANAGEMENT),
+		_GetBoolSetting(ioExtension, HEIC_SETTING_HIGH_BIT_DEPTH),
+		_GetBoolSetting(ioExtension, B_TRANSLATOR_EXT_DATA_ONLY),
+		(int32)region.left, (int32)region.top,
+		(int32)region.right, (int32)region.bottom
+	};
+	hash = fingerprint_data(parameters, sizeof(parameters));
+	return true;
+}
+
+
+// The key covers the contents of the file as well, so it holds for any
+// copy of the file anywhere
+bool
+HEICTranslator::_DiskCacheKey(BMessage *ioExtension, const HEICInput *input,
+	BPath &directory, uint64 &key)
+{
+	uint64 parameters;
+	if (!_GetBoolSetting(ioExtension, HEIC_SETTING_DISK_CACHE)
+		|| _GetInt32Setting(ioExtension, HEIC_SETTING_DISK_CACHE_SIZE) <= 0
+		|| input->Data() == NULL
+		|| !_OutputParameters(ioExtension, parameters))
+		return false;
+
+	const char *path;
+	if (ioExtension != NULL && ioExtension->FindString(
+			HEIC_SETTING_DISK_CACHE_DIRECTORY, &path) == B_OK)
+		directory.SetTo(path);
+	else if (find_directory(B_USER_CACHE_DIRECTORY, &directory, true) != B_OK
+		|| directory.Append("HEICTranslator") != B_OK)
+		return false;
+
+	if (directory.InitCheck() != B_OK
+		|| (mkdir(directory.Path(), 0755) != 0 && errno != EEXIST))
+		return false;
+
+	key = fingerprint_data(input->Data(), input->Size(), parameters);
+	return true;
+}
+
+
+// Servers running many translations at once cap this to avoid
+// oversubscribing the CPUs, a viewer wants them all for one image
+int32
+HEICTranslator::_DecoderThreads(BMessage *ioExtension)
+{
+	int32 threads = _GetInt32Setting(ioExtension,
+		HEIC_SETTING_DECODER_THREADS);
+	if (threads <= 0)
+		threads = WorkerPool::CPUCount();
+
+	return threads;
 }
 
 
@@ -14,13 +14,102 @@
 
 #include "shared/BaseTranslator.h"
 #include "shared/TranslatorSettings.h"
+#include "BitmapCache.h"
+#include "ColorProfile.h"
+#include "ContextCache.h"
+#include "DecodeStatePool.h"
+#include "DiskCache.h"
+#include "IdentifyCache.h"
+#include "RequestSettings.h"
+#include "WorkerPool.h"
 #include <DataIO.h>
 #include <Message.h>
+#include <Path.h>
 #include <SupportDefs.h>
 #include <TranslationDefs.h>
 
+struct heif_context;
+struct heif_image_handle;
+
 #define HEIC_TRANSLATOR_VERSION B_TRANSLATION_MAKE_VERSION(0,2,0)
 #define HEIC_IMAGE_FORMAT	'HEIC'
+#define HEIC_SEQUENCE_FORMAT	'HEIS'
+#define HEIF_IMAGE_FORMAT	'HEIF'
+#define HEIF_SEQUENCE_FORMAT	'HEFS'
+#define AVIF_IMAGE_FORMAT	'AVIF'
+#define AVCI_IMAGE_FORMAT	'AVCI'
+	// only the primary image of sequences is translated
+
+// Translator specific settings, and options that are only taken from
+// ioExtension. A setting given in ioExtension under the name below only
+// applies to that request; the saved settings are kept under
+// HEIC_SAVED_SETTING() of the name, see RequestSettings.h. The same goes
+// for B_TRANSLATOR_EXT_HEADER_ONLY and B_TRANSLATOR_EXT_DATA_ONLY.
+#define HEIC_SETTING_MAX_SIZE	"heic /maxSize"
+	// int32, ioExtension only: longest side the caller needs, 0 for the
+	// full image; larger images are scaled down to it
+#define HEIC_SETTING_SCALE_FILTER	"heic /scaleFilter"
+	// int32, ioExtension only: one of the resample_filter constants from
+	// Resampler.h, RESAMPLE_BILINEAR if not given
+#define HEIC_SETTING_DECODER_THREADS	"heic /decoderThreads"
+	// int32, threads a single image may decode and convert on, 0 for one
+	// per CPU
+#define HEIC_SETTING_CONVERT_YCBCR	"heic /convertYCbCr"
+	// bool, convert 8 bit Y'CbCr ourselves in one pass instead of having
+	// libheif produce RGBA first; chroma is upsampled nearest neighbour
+#define HEIC_SETTING_COLOR_SPACE	"heic /colorSpace"
+	// int32, ioExtension only: color_space to write. B_NO_COLOR_SPACE,
+	// the default, picks the smallest of B_RGBA32, B_RGB32 and B_GRAY8
+	// that holds the image, B_RGB24 allows packed pixels instead of
+	// B_RGB32, B_RGB32 and B_RGBA32 ask for those. B_RGBA64 keeps all
+	// bits of 10 and 12 bit images. B_YCbCr422 and B_YCbCr420 are packed
+	// from the decoded planes without colour conversion. Alpha is always
+	// kept, and scaled images are B_RGBA32 or B_RGB32.
+#define HEIC_SETTING_APPLY_TRANSFORMS	"heic /applyTransforms"
+	// bool, turn the image the right way up and crop it as its irot,
+	// imir and clap properties say; off writes the image as coded
+#define HEIC_SETTING_COLOR_MANAGEMENT	"heic /colorManagement"
+	// bool, convert images with an ICC or nclx profile to sRGB; only RGB
+	// matrix/TRC profiles and SDR transfer curves are followed
+#define HEIC_SETTING_HIGH_BIT_DEPTH	"heic /highBitDepth"
+	// bool, decode 10 and 12 bit images at their own depth and dither
+	// them to 8 bits ourselves; off has libheif convert to 8 bits first
+#define HEIC_SETTING_IDENTIFY_CACHE	"heic /identifyCache"
+	// bool, remember what files looked like by device, node, size and
+	// modification time, so identifying them again does not read them,
+	// nor does asking for the header of one translated before
+#define HEIC_SETTING_CONTEXT_CACHE	"heic /contextCache"
+	// bool, keep files that were just translated parsed for a while, so
+	// translating them again starts decoding right away
+#define HEIC_SETTING_DISK_CACHE	"heic /diskCache"
+	// bool, keep decoded images in files and serve translations that
+	// were made before from them, across runs and processes
+#define HEIC_SETTING_DISK_CACHE_SIZE	"heic /diskCacheSize"
+	// int32, MB the cache files may take up in all; the least recently
+	// used ones are removed beyond that
+#define HEIC_SETTING_DISK_CACHE_DIRECTORY	"heic /diskCacheDirectory"
+	// string, ioExtension only: where to keep the cache files instead of
+	// HEICTranslator in the user cache directory
+#define HEIC_SETTING_BITMAP_CACHE_SIZE	"heic /bitmapCacheSize"
+	// int32, MB of translations of files to keep in memory and write
+	// again when asked for the same file with the same settings, 64 by
+	// default. A request can only give 0, to neither use nor fill the
+	// cache; other sizes are taken from the saved setting alone.
+#define HEIC_SETTING_REGION	"heic /region"
+	// BRect, ioExtension only: write just this part of the image, in
+	// pixels of the image as it is written out. Grid images only decode
+	// the tiles it touches. maxSize then applies to the region.
+#define HEIC_SETTING_PYRAMID_LEVELS	"heic /pyramidLevels"
+	// int32, ioExtension only: write the image followed by this many
+	// levels in all, each a bitmap with its own header at half the size
+	// of the one before, from a single decode. 0 or 1 for just the
+	// image. Levels below the first need 8 bit channels, and headers are
+	// always written.
+#define HEIC_SETTING_PYRAMID_OFFSET	"heic /pyramidOffset"
+	// int64, set in ioExtension for each level written: where its header
+	// starts, counted from the start of the first level
+#define HEIC_SETTING_PYRAMID_BOUNDS	"heic /pyramidBounds"
+	// BRect, set in ioExtension for each level written
 
 class HEICTranslator : public BaseTranslator {
 public:
@@ -35,10 +124,40 @@ public:
 					const translator_info *inInfo, BMessage *ioExtension,
 					uint32 outType, BPositionIO *outDestination, int32 baseType);
 
+				virtual status_t GetConfigurationMessage(BMessage *ioExtension);
+					// also reports the decode state pool, colour table,
+					// identify, context, disk and bitmap cache statistics
+
 				virtual BView *NewConfigView(TranslatorSettings *settings);
 
 private:
+				status_t _TranslateImage(heif_context *ctx,
+					BLocker *readLock, BMessage *ioExtension,
+					BPositionIO *target, DecodeState &state,
+					image_metadata &primary);
+				status_t _WriteImage(heif_context *ctx, BLocker *readLock,
+					heif_image_handle *handle,
+					const image_metadata &metadata, const color_lut *lut,
+					BMessage *ioExtension, BPositionIO *target,
+					DecodeState &state);
+					// header only requests need neither ctx nor handle;
+					// readLock is the one of the HEICInput ctx reads
+
+				bool _GetBoolSetting(BMessage *ioExtension, const char *name);
+				int32 _GetInt32Setting(BMessage *ioExtension, const char *name);
+				int32 _DecoderThreads(BMessage *ioExtension);
+				bool _OutputParameters(BMessage *ioExtension, uint64 &hash);
+				bool _DiskCacheKey(BMessage *ioExtension,
+					const HEICInput *input, BPath &directory, uint64 &key);
 
+				WorkerPool fWorkerPool;
+					// shared by all translations of this add-on
+				DecodeStatePool fDecodeStates;
+				ColorLUTCache fColorLUTs;
+				IdentifyCache fIdentifyCache;
+				ContextCache fContexts;
+				DiskCache fDiskCache;
+				BitmapCache fBitmaps;
 };
 
 #endif // HEICTRANSLATOR_H
@@ -0,0 +1,138 @@
+/*
+ * HEIFBrands.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "HEIFBrands.h"
+
+#include <ByteOrder.h>
+#include <string.h>
+
+
+struct brand {
+	uint32				type;
+	uint32				flags;
+};
+
+static const brand kBrands[] = {
+	{ 'heic', HEIF_BRAND_HEVC_IMAGE },
+	{ 'heix', HEIF_BRAND_HEVC_IMAGE },
+	{ 'heim', HEIF_BRAND_HEVC_IMAGE },
+	{ 'heis', HEIF_BRAND_HEVC_IMAGE },
+	{ 'hevc', HEIF_BRAND_HEVC_SEQUENCE },
+	{ 'hevx', HEIF_BRAND_HEVC_SEQUENCE },
+	{ 'hevm', HEIF_BRAND_HEVC_SEQUENCE },
+	{ 'hevs', HEIF_BRAND_HEVC_SEQUENCE },
+	{ 'mif1', HEIF_BRAND_IMAGE },
+	{ 'mif2', HEIF_BRAND_IMAGE },
+	{ 'heif', HEIF_BRAND_IMAGE },
+	{ 'msf1', HEIF_BRAND_SEQUENCE },
+	{ 'avif', HEIF_BRAND_AV1_IMAGE },
+	{ 'avis', HEIF_BRAND_AV1_SEQUENCE },
+	{ 'avci', HEIF_BRAND_AVC_IMAGE },
+	{ 'avcs', HEIF_BRAND_AVC_SEQUENCE },
+	{ 'vvic', HEIF_BRAND_VVC_IMAGE },
+	{ 'vvis', HEIF_BRAND_VVC_SEQUENCE },
+	{ 'jpeg', HEIF_BRAND_JPEG_IMAGE },
+	{ 'j2ki', HEIF_BRAND_JPEG2000_IMAGE }
+};
+
+
+static inline uint32
+read32(const uint8 *data)
+{
+	uint32 value;
+	memcpy(&value, data, sizeof(value));
+	return B_BENDIAN_TO_HOST_INT32(value);
+}
+
+
+static uint32
+brand_flags(uint32 type)
+{
+	for (size_t i = 0; i < sizeof(kBrands) / sizeof(kBrands[0]); i++) {
+		if (kBrands[i].type == type)
+			return kBrands[i].flags;
+	}
+	return 0;
+}
+
+
+uint32
+read_ftyp_brands(const uint8 *data, size_t length)
+{
+	if (length < 16 || read32(data + 4) != 'ftyp')
+		return 0;
+
+	// A size of 1 is followed by a 64 bit one, 0 runs to the end
+	uint64 size = read32(data);
+	size_t offset = 8;
+	if (size == 1) {
+		if (length < 24)
+			return 0;
+		size = ((uint64)read32(data + 8) << 32) | read32(data + 12);
+		offset = 16;
+	} else if (size == 0)
+		size = length;
+	if (size < offset + 8)
+		return 0;
+
+	// The major brand, then the compatible ones after the minor version
+	uint32 flags = brand_flags(read32(data + offset));
+	size_t end = min_c(size, (uint64)length);
+	for (size_t i = offset + 8; i + 4 <= end; i += 4)
+		flags |= brand_flags(read32(data + i));
+
+	return flags;
+}
+
+
+bool
+brands_match(uint32 brands, float &quality, float &capability,
+	heif_file_format &format)
+{
+	// Only the primary image of a file is translated, a sequence needs
+	// to come with one
+	if ((brands & HEIF_BRAND_ANY_IMAGE) == 0)
+		return false;
+
+	bool sequence = (brands & (HEIF_BRAND_SEQUENCE | HEIF_BRAND_HEVC_SEQUENCE
+		| HEIF_BRAND_AV1_SEQUENCE | HEIF_BRAND_AVC_SEQUENCE
+		| HEIF_BRAND_VVC_SEQUENCE)) != 0;
+
+	if ((brands & HEIF_BRAND_HEVC_IMAGE) != 0) {
+		format = HEIF_FORMAT_HEIC;
+		return true;
+	}
+
+	if ((brands & HEIF_BRAND_OTHER_CODEC) == 0) {
+		// most likely HEVC, but the file does not say
+		if ((brands & HEIF_BRAND_HEVC_SEQUENCE) != 0)
+			format = HEIF_FORMAT_HEIC_SEQUENCE;
+		else
+			format = sequence ? HEIF_FORMAT_HEIF_SEQUENCE : HEIF_FORMAT_HEIF;
+		quality *= 0.8f;
+		capability *= 0.8f;
+		return true;
+	}
+
+	// libheif may have a decoder for it, but a dedicated translator
+	// should be preferred; the codec brand alone does not make a HEIF file
+	if ((brands & (HEIF_BRAND_IMAGE | HEIF_BRAND_SEQUENCE
+			| HEIF_BRAND_HEVC_SEQUENCE)) == 0)
+		return false;
+
+	if ((brands & (HEIF_BRAND_AV1_IMAGE | HEIF_BRAND_AV1_SEQUENCE)) != 0)
+		format = HEIF_FORMAT_AVIF;
+	else if ((brands & (HEIF_BRAND_AVC_IMAGE | HEIF_BRAND_AVC_SEQUENCE)) != 0)
+		format = HEIF_FORMAT_AVCI;
+	else
+		format = sequence ? HEIF_FORMAT_HEIF_SEQUENCE : HEIF_FORMAT_HEIF;
+	quality *= 0.4f;
+	capability *= 0.3f;
+	return true;
+}
@@ -0,0 +1,78 @@
+/*
+ * HEIFBrands.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef HEIFBRANDS_H
+#define HEIFBRANDS_H
+
+
+#include <SupportDefs.h>
+
+
+// What the brands in the ftyp box say a file holds
+enum {
+	HEIF_BRAND_HEVC_IMAGE		= 0x0001,
+		// heic, heix and the other HEVC still image brands
+	HEIF_BRAND_HEVC_SEQUENCE	= 0x0002,
+	HEIF_BRAND_IMAGE			= 0x0004,
+		// mif1 and the like, which do not name the codec
+	HEIF_BRAND_SEQUENCE			= 0x0008,
+	HEIF_BRAND_AV1_IMAGE		= 0x0010,
+	HEIF_BRAND_AV1_SEQUENCE		= 0x0020,
+	HEIF_BRAND_AVC_IMAGE		= 0x0040,
+	HEIF_BRAND_AVC_SEQUENCE		= 0x0080,
+	HEIF_BRAND_VVC_IMAGE		= 0x0100,
+	HEIF_BRAND_VVC_SEQUENCE		= 0x0200,
+	HEIF_BRAND_JPEG_IMAGE		= 0x0400,
+	HEIF_BRAND_JPEG2000_IMAGE	= 0x0800,
+
+	HEIF_BRAND_ANY_IMAGE		= HEIF_BRAND_HEVC_IMAGE | HEIF_BRAND_IMAGE
+		| HEIF_BRAND_AV1_IMAGE | HEIF_BRAND_AVC_IMAGE | HEIF_BRAND_VVC_IMAGE
+		| HEIF_BRAND_JPEG_IMAGE | HEIF_BRAND_JPEG2000_IMAGE,
+	HEIF_BRAND_OTHER_CODEC		= HEIF_BRAND_AV1_IMAGE
+		| HEIF_BRAND_AV1_SEQUENCE | HEIF_BRAND_AVC_IMAGE
+		| HEIF_BRAND_AVC_SEQUENCE | HEIF_BRAND_VVC_IMAGE
+		| HEIF_BRAND_VVC_SEQUENCE | HEIF_BRAND_JPEG_IMAGE
+		| HEIF_BRAND_JPEG2000_IMAGE
+};
+
+// The kinds of file the brands make out, each with its own MIME type
+enum heif_file_format {
+	HEIF_FORMAT_HEIC = 0,
+		// image/heic
+	HEIF_FORMAT_HEIC_SEQUENCE,
+		// image/heic-sequence
+	HEIF_FORMAT_HEIF,
+		// image/heif, for codecs without a type of their own
+	HEIF_FORMAT_HEIF_SEQUENCE,
+		// image/heif-sequence
+	HEIF_FORMAT_AVIF,
+		// image/avif
+	HEIF_FORMAT_AVCI,
+		// image/avci
+
+	HEIF_FORMAT_COUNT
+};
+
+const size_t kFileTypeHeaderSize = 64;
+	// enough for the ftyp box of every camera we have seen
+
+
+uint32				read_ftyp_brands(const uint8 *data, size_t length);
+	// classifies the major and compatible brands of the ftyp box at the
+	// start of data, returns 0 if there is none or it names no HEIF brand;
+	// brands past length are not looked at
+
+bool				brands_match(uint32 brands, float &quality,
+						float &capability, heif_file_format &format);
+	// scales the quality and capability of the input format to what we
+	// can do with such a file and tells which format it is, returns false
+	// if we leave it alone; files with only sequence brands are left
+	// alone, as we translate images, not sequences
+
+
+#endif // HEIFBRANDS_H
@@ -0,0 +1,226 @@
+/*
+ * IdentifyCache.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "IdentifyCache.h"
+
+#include <Autolock.h>
+#include <new>
+#include <string.h>
+
+
+struct IdentifyCache::entry {
+	file_identity		identity;
+	uint32				hash;
+	uint32				brands;
+	image_metadata		metadata;
+	bool				hasMetadata;
+	entry				*nextInBucket;
+	entry				*previous;
+	entry				*next;
+};
+
+
+IdentifyCache::IdentifyCache(int32 maxEntries)
+	:
+	fLock("heic identify cache"),
+	fEntries(NULL),
+	fBuckets(NULL),
+	fBucketCount(0),
+	fCount(0),
+	fMaxEntries(max_c(maxEntries, 1)),
+	fFirst(NULL),
+	fLast(NULL),
+	fHits(0),
+	fMisses(0),
+	fMetadataHits(0)
+{
+}
+
+
+IdentifyCache::~IdentifyCache()
+{
+	delete[] fEntries;
+	delete[] fBuckets;
+}
+
+
+bool
+IdentifyCache::Lookup(const file_identity &identity, uint32 &brands)
+{
+	BAutolock _(fLock);
+
+	entry *current = NULL;
+	if (fBuckets != NULL)
+		current = _Find(identity, hash_file_identity(identity));
+	if (current == NULL) {
+		fMisses++;
+		return false;
+	}
+
+	if (current != fFirst) {
+		_Unlink(current);
+		_LinkFirst(current);
+	}
+
+	fHits++;
+	brands = current->brands;
+	return true;
+}
+
+
+void
+IdentifyCache::Add(const file_identity &identity, uint32 brands)
+{
+	BAutolock _(fLock);
+
+	if (fEntries == NULL && _Init() != B_OK)
+		return;
+
+	uint32 hash = hash_file_identity(identity);
+	entry *current = _Find(identity, hash);
+	if (current != NULL) {
+		current->brands = brands;
+		return;
+	}
+
+	if (fCount < fMaxEntries)
+		current = &fEntries[fCount++];
+	else {
+		// Reuse the least recently used entry
+		current = fLast;
+		_Unlink(current);
+
+		entry **link = &fBuckets[current->hash % fBucketCount];
+		while (*link != current)
+			link = &(*link)->nextInBucket;
+		*link = current->nextInBucket;
+	}
+
+	current->identity = identity;
+	current->hash = hash;
+	current->brands = brands;
+	current->hasMetadata = false;
+
+	entry **bucket = &fBuckets[hash % fBucketCount];
+	current->nextInBucket = *bucket;
+	*bucket = current;
+	_LinkFirst(current);
+}
+
+
+bool
+IdentifyCache::LookupMetadata(const file_identity &identity,
+	image_metadata &metadata)
+{
+	BAutolock _(fLock);
+
+	entry *current = NULL;
+	if (fBuckets != NULL)
+		current = _Find(identity, hash_file_identity(identity));
+	if (current == NULL || !current->hasMetadata)
+		return false;
+
+	if (current != fFirst) {
+		_Unlink(current);
+		_LinkFirst(current);
+	}
+
+	fMetadataHits++;
+	metadata = current->metadata;
+	return true;
+}
+
+
+void
+IdentifyCache::AddMetadata(const file_identity &identity,
+	const image_metadata &metadata)
+{
+	BAutolock _(fLock);
+
+	// The brands are not known here, the entry is left to Add()
+	entry *current = NULL;
+	if (fBuckets != NULL)
+		current = _Find(identity, hash_file_identity(identity));
+	if (current == NULL)
+		return;
+
+	current->metadata = metadata;
+	current->hasMetadata = true;
+}
+
+
+void
+IdentifyCache::AddStatistics(BMessage *message)
+{
+	BAutolock _(fLock);
+
+	message->SetInt64("heic /identifyCacheHits", fHits);
+	message->SetInt64("heic /identifyCacheMisses", fMisses);
+	message->SetInt64("heic /identifyCacheMetadataHits", fMetadataHits);
+}
+
+
+status_t
+IdentifyCache::_Init()
+{
+	// Allocated on first use, most add-on instances never identify a file
+	fBucketCount = fMaxEntries * 2 - 1;
+	fEntries = new(std::nothrow) entry[fMaxEntries];
+	fBuckets = new(std::nothrow) entry*[fBucketCount];
+	if (fEntries == NULL || fBuckets == NULL) {
+		delete[] fEntries;
+		delete[] fBuckets;
+		fEntries = NULL;
+		fBuckets = NULL;
+		return B_NO_MEMORY;
+	}
+
+	memset(fBuckets, 0, sizeof(entry*) * fBucketCount);
+	return B_OK;
+}
+
+
+IdentifyCache::entry*
+IdentifyCache::_Find(const file_identity &identity, uint32 hash)
+{
+	entry *current = fBuckets[hash % fBucketCount];
+	while (current != NULL) {
+		if (current->hash == hash && current->identity == identity)
+			return current;
+		current = current->nextInBucket;
+	}
+	return NULL;
+}
+
+
+void
+IdentifyCache::_Unlink(entry *current)
+{
+	if (current->previous != NULL)
+		current->previous->next = current->next;
+	else
+		fFirst = current->next;
+	if (current->next != NULL)
+		current->next->previous = current->previous;
+	else
+		fLast = current->previous;
+}
+
+
+void
+IdentifyCache::_LinkFirst(entry *current)
+{
+	current->previous = NULL;
+	current->next = fFirst;
+	if (fFirst != NULL)
+		fFirst->previous = current;
+	else
+		fLast = current;
+	fFirst = current;
+}
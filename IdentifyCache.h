@@ -0,0 +1,86 @@
+/*
+ * IdentifyCache.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef IDENTIFYCACHE_H
+#define IDENTIFYCACHE_H
+
+
+#include <Locker.h>
+#include <Message.h>
+
+#include "HEICInput.h"
+
+
+// What is needed of the primary image to write its bitmap header, as
+// libheif reports it
+struct image_metadata {
+	int32				width;
+	int32				height;
+	int32				ispeWidth;
+	int32				ispeHeight;
+		// before irot, imir and clap are applied
+	int32				lumaBits;
+	int32				chromaBits;
+	bool				hasAlpha;
+	bool				monochrome;
+		// decodes to a single plane
+};
+
+
+// Tracker and file panels ask every translator about every file in a
+// folder, and ask again each time the folder is shown. The ftyp brands of
+// each file seen are kept by its identity, so a file that has not changed
+// since is answered without reading it. Files that are not HEIF at all
+// are kept too, with no brands. Once a file has been translated, the
+// metadata of its primary image is kept along with them, so that asking
+// for its header again does not parse it.
+class IdentifyCache {
+public:
+								IdentifyCache(int32 maxEntries = 1024);
+								~IdentifyCache();
+
+			bool				Lookup(const file_identity &identity,
+									uint32 &brands);
+			void				Add(const file_identity &identity,
+									uint32 brands);
+
+			bool				LookupMetadata(
+									const file_identity &identity,
+									image_metadata &metadata);
+			void				AddMetadata(const file_identity &identity,
+									const image_metadata &metadata);
+									// only for files identified before
+
+			void				AddStatistics(BMessage *message);
+
+private:
+			struct entry;
+
+			status_t			_Init();
+			entry*				_Find(const file_identity &identity,
+									uint32 hash);
+			void				_Unlink(entry *current);
+			void				_LinkFirst(entry *current);
+
+			BLocker				fLock;
+			entry				*fEntries;
+			entry				**fBuckets;
+			int32				fBucketCount;
+			int32				fCount;
+			int32				fMaxEntries;
+			entry				*fFirst;
+			entry				*fLast;
+				// most recently used first
+
+			int64				fHits;
+			int64				fMisses;
+			int64				fMetadataHits;
+};
+
+
+#endif // IDENTIFYCACHE_H
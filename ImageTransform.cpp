@@ -0,0 +1,219 @@
+/*
+ * ImageTransform.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "ImageTransform.h"
+
+#include <string.h>
+
+
+// Output blocks of this many rows and columns are transposed at a time;
+// 64 x 64 B_RGBA32 pixels are 16 KB, which stays in the L1 cache
+static const int32 kBlockSize = 64;
+
+
+// Chains a step that gives the pixel (x, y) of the image so far for each
+// pixel (x', y') of the new image as
+// (cx + pxx * x' + pxy * y', cy + pyx * x' + pyy * y').
+static void
+compose(image_transform &transform, int32 cx, int32 cy, int32 pxx,
+	int32 pxy, int32 pyx, int32 pyy)
+{
+	image_transform old = transform;
+	transform.originX = old.originX + old.xStepX * cx + old.yStepX * cy;
+	transform.originY = old.originY + old.xStepY * cx + old.yStepY * cy;
+	transform.xStepX = old.xStepX * pxx + old.yStepX * pyx;
+	transform.xStepY = old.xStepY * pxx + old.yStepY * pyx;
+	transform.yStepX = old.xStepX * pxy + old.yStepX * pyy;
+	transform.yStepY = old.xStepY * pxy + old.yStepY * pyy;
+}
+
+
+static inline void
+copy_pixel(uint8 *dest, const uint8 *source, uint32 pixelBytes)
+{
+	if (pixelBytes == 4)
+		*(uint32 *)dest = *(const uint32 *)source;
+	else
+		memcpy(dest, source, pixelBytes);
+}
+
+
+static void
+reverse_pixels(uint8 *row, int32 width, uint32 pixelBytes)
+{
+	if (pixelBytes == 4) {
+		// B_RGBA32 and B_RGB32, swapped a whole pixel at a time
+		uint32 *left = (uint32 *)row;
+		uint32 *right = left + width - 1;
+		while (left < right) {
+			uint32 swap = *left;
+			*left++ = *right;
+			*right-- = swap;
+		}
+		return;
+	}
+
+	uint8 *left = row;
+	uint8 *right = row + (width - 1) * pixelBytes;
+	uint8 swap[8];
+	while (left < right) {
+		memcpy(swap, left, pixelBytes);
+		memcpy(left, right, pixelBytes);
+		memcpy(right, swap, pixelBytes);
+		left += pixelBytes;
+		right -= pixelBytes;
+	}
+}
+
+
+void
+init_image_transform(image_transform &transform, int32 width, int32 height)
+{
+	transform.width = width;
+	transform.height = height;
+	transform.originX = 0;
+	transform.originY = 0;
+	transform.xStepX = 1;
+	transform.xStepY = 0;
+	transform.yStepX = 0;
+	transform.yStepY = 1;
+}
+
+
+bool
+transform_crop(image_transform &transform, int32 left, int32 top,
+	int32 width, int32 height)
+{
+	if (left < 0 || top < 0 || width <= 0 || height <= 0
+		|| left + width > transform.width || top + height > transform.height)
+		return false;
+
+	compose(transform, left, top, 1, 0, 0, 1);
+	transform.width = width;
+	transform.height = height;
+	return true;
+}
+
+
+bool
+transform_rotate_ccw(image_transform &transform, int32 degrees)
+{
+	int32 width = transform.width;
+	int32 height = transform.height;
+
+	switch (((degrees % 360) + 360) % 360) {
+		case 0:
+			break;
+		case 90:
+			// the right column becomes the top row
+			compose(transform, width - 1, 0, 0, -1, 1, 0);
+			transform.width = height;
+			transform.height = width;
+			break;
+		case 180:
+			compose(transform, width - 1, height - 1, -1, 0, 0, -1);
+			break;
+		case 270:
+			// the left column becomes the top row, bottom first
+			compose(transform, 0, height - 1, 0, 1, -1, 0);
+			transform.width = height;
+			transform.height = width;
+			break;
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+
+void
+transform_mirror(image_transform &transform, bool leftRight)
+{
+	if (leftRight)
+		compose(transform, transform.width - 1, 0, -1, 0, 0, 1);
+	else
+		compose(transform, 0, transform.height - 1, 1, 0, 0, -1);
+}
+
+
+bool
+is_identity_transform(const image_transform &transform, int32 sourceWidth,
+	int32 sourceHeight)
+{
+	return transform.width == sourceWidth && transform.height == sourceHeight
+		&& transform.originX == 0 && transform.originY == 0
+		&& transform.xStepX == 1 && transform.yStepY == 1
+		&& transform.xStepY == 0 && transform.yStepX == 0;
+}
+
+
+void
+transform_rows(const image_transform &transform, const uint8 *source,
+	size_t sourceStride, uint32 sourcePixelBytes, convert_rows_func convert,
+	uint32 destPixelBytes, int32 firstRow, int32 rowCount, uint8 *dest,
+	size_t destStride)
+{
+	int32 width = transform.width;
+
+	if (transform.yStepX == 0) {
+		// Output rows are source rows, possibly running backwards
+		for (int32 y = firstRow; y < firstRow + rowCount; y++) {
+			int32 sourceY = transform.originY + y * transform.yStepY;
+			int32 sourceX = transform.xStepX > 0
+				? transform.originX : transform.originX - width + 1;
+			uint8 *out = dest + (y - firstRow) * destStride;
+
+			// A mirrored row is converted from its right end
+			convert(source + sourceY * sourceStride
+					+ sourceX * sourcePixelBytes,
+				sourceStride, out, destStride, width, 1,
+				transform.xStepX > 0 ? 0 : 1 - width, y);
+			if (transform.xStepX < 0)
+				reverse_pixels(out, width, destPixelBytes);
+		}
+		return;
+	}
+
+	// Output columns are source rows: convert a short run of a source
+	// row at a time and spread it down its output column. Going block
+	// by block keeps the rows written to in the cache until all their
+	// columns are filled in.
+	uint8 run[kBlockSize * 8];
+	for (int32 y0 = firstRow; y0 < firstRow + rowCount; y0 += kBlockSize) {
+		int32 rows = min_c(kBlockSize, firstRow + rowCount - y0);
+		uint8 *blockRow = dest + (y0 - firstRow) * destStride;
+
+		for (int32 x0 = 0; x0 < width; x0 += kBlockSize) {
+			int32 columns = min_c(kBlockSize, width - x0);
+
+			for (int32 x = x0; x < x0 + columns; x++) {
+				int32 sourceY = transform.originY + x * transform.xStepY;
+				int32 sourceX = transform.originX + y0 * transform.yStepX;
+				if (transform.yStepX < 0)
+					sourceX -= rows - 1;
+
+				// The run goes down output column x, so the converter
+				// sees the output transposed
+				convert(source + sourceY * sourceStride
+						+ sourceX * sourcePixelBytes,
+					sourceStride, run, 0, rows, 1,
+					transform.yStepX > 0 ? y0 : 1 - y0 - rows, x);
+
+				uint8 *out = blockRow + x * destPixelBytes;
+				for (int32 i = 0; i < rows; i++) {
+					int32 index = transform.yStepX > 0 ? i : rows - 1 - i;
+					copy_pixel(out, run + index * destPixelBytes,
+						destPixelBytes);
+					out += destStride;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ * ImageTransform.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef IMAGETRANSFORM_H
+#define IMAGETRANSFORM_H
+
+
+#include "PixelConverter.h"
+
+
+// Maps output pixels to the pixels of the coded image, after any number
+// of crops, rotations and mirrors. Source pixel of output (x, y) is
+// (originX + x * xStepX + y * yStepX, originY + x * xStepY + y * yStepY)
+// with every step being -1, 0 or 1.
+struct image_transform {
+	int32				width;
+	int32				height;
+		// of the output
+	int32				originX;
+	int32				originY;
+	int32				xStepX;
+	int32				xStepY;
+	int32				yStepX;
+	int32				yStepY;
+};
+
+
+void				init_image_transform(image_transform &transform,
+						int32 width, int32 height);
+bool				transform_crop(image_transform &transform, int32 left,
+						int32 top, int32 width, int32 height);
+bool				transform_rotate_ccw(image_transform &transform,
+						int32 degrees);
+	// degrees must be a multiple of 90
+void				transform_mirror(image_transform &transform,
+						bool leftRight);
+	// a left-right mirror flips each row, otherwise the rows are
+	// flipped top to bottom
+bool				is_identity_transform(const image_transform &transform,
+						int32 sourceWidth, int32 sourceHeight);
+
+void				transform_rows(const image_transform &transform,
+						const uint8 *source, size_t sourceStride,
+						uint32 sourcePixelBytes, convert_rows_func convert,
+						uint32 destPixelBytes, int32 firstRow,
+						int32 rowCount, uint8 *dest, size_t destStride);
+	// converts output rows [firstRow, firstRow + rowCount) from the
+	// coded image in one pass. Rotations by 90 and 270 degrees go
+	// through the image in small blocks, so that neither side of the
+	// transposition leaves the cache.
+
+
+#endif // IMAGETRANSFORM_H
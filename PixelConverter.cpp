@@ -0,0 +1,1007 @@
+/*
+ * PixelConverter.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "PixelConverter.h"
+
+#include <ByteOrder.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#	define HEIC_X86_KERNELS 1
+#	include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#	define HEIC_NEON_KERNELS 1
+#	include <arm_neon.h>
+#endif
+
+
+static void
+swizzle_row_scalar(const uint8 *src, uint8 *dest, int32 pixels)
+{
+	for (int32 x = 0; x < pixels; x++) {
+		uint8 r = *src++;
+		uint8 g = *src++;
+		uint8 b = *src++;
+		uint8 a = *src++;
+		*dest++ = b;
+		*dest++ = g;
+		*dest++ = r;
+		*dest++ = a;
+	}
+}
+
+
+#ifdef HEIC_X86_KERNELS
+
+__attribute__((target("sse2")))
+static void
+swizzle_row_sse2(const uint8 *src, uint8 *dest, int32 pixels)
+{
+	// Without a byte shuffle we swap R and B with shifts: G and A stay
+	// in place, R moves up and B moves down by 16 bits.
+	const __m128i keepMask = _mm_set1_epi32(0xff00ff00);
+	const __m128i lowMask = _mm_set1_epi32(0x000000ff);
+	const __m128i highMask = _mm_set1_epi32(0x00ff0000);
+
+	int32 x = 0;
+	for (; x + 4 <= pixels; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + x * 4));
+		__m128i swapped = _mm_or_si128(_mm_and_si128(v, keepMask),
+			_mm_or_si128(
+				_mm_and_si128(_mm_srli_epi32(v, 16), lowMask),
+				_mm_and_si128(_mm_slli_epi32(v, 16), highMask)));
+		_mm_storeu_si128((__m128i *)(dest + x * 4), swapped);
+	}
+
+	swizzle_row_scalar(src + x * 4, dest + x * 4, pixels - x);
+}
+
+
+__attribute__((target("ssse3")))
+static void
+swizzle_row_ssse3(const uint8 *src, uint8 *dest, int32 pixels)
+{
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7,
+		10, 9, 8, 11, 14, 13, 12, 15);
+
+	int32 x = 0;
+	for (; x + 8 <= pixels; x += 8) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)(src + x * 4));
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(src + x * 4 + 16));
+		_mm_storeu_si128((__m128i *)(dest + x * 4),
+			_mm_shuffle_epi8(v0, shuffle));
+		_mm_storeu_si128((__m128i *)(dest + x * 4 + 16),
+			_mm_shuffle_epi8(v1, shuffle));
+	}
+	for (; x + 4 <= pixels; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + x * 4));
+		_mm_storeu_si128((__m128i *)(dest + x * 4),
+			_mm_shuffle_epi8(v, shuffle));
+	}
+
+	swizzle_row_scalar(src + x * 4, dest + x * 4, pixels - x);
+}
+
+
+__attribute__((target("avx2")))
+static void
+swizzle_row_avx2(const uint8 *src, uint8 *dest, int32 pixels)
+{
+	// vpshufb works within 128 bit lanes, so the pattern is repeated
+	const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7,
+		10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7,
+		10, 9, 8, 11, 14, 13, 12, 15);
+
+	int32 x = 0;
+	for (; x + 16 <= pixels; x += 16) {
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)(src + x * 4));
+		__m256i v1 = _mm256_loadu_si256((const __m256i *)(src + x * 4 + 32));
+		_mm256_storeu_si256((__m256i *)(dest + x * 4),
+			_mm256_shuffle_epi8(v0, shuffle));
+		_mm256_storeu_si256((__m256i *)(dest + x * 4 + 32),
+			_mm256_shuffle_epi8(v1, shuffle));
+	}
+	for (; x + 8 <= pixels; x += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + x * 4));
+		_mm256_storeu_si256((__m256i *)(dest + x * 4),
+			_mm256_shuffle_epi8(v, shuffle));
+	}
+
+	swizzle_row_scalar(src + x * 4, dest + x * 4, pixels - x);
+}
+
+#endif // HEIC_X86_KERNELS
+
+
+#ifdef HEIC_NEON_KERNELS
+
+static void
+swizzle_row_neon(const uint8 *src, uint8 *dest, int32 pixels)
+{
+	int32 x = 0;
+	for (; x + 16 <= pixels; x += 16) {
+		uint8x16x4_t v = vld4q_u8(src + x * 4);
+		uint8x16_t red = v.val[0];
+		v.val[0] = v.val[2];
+		v.val[2] = red;
+		vst4q_u8(dest + x * 4, v);
+	}
+
+	swizzle_row_scalar(src + x * 4, dest + x * 4, pixels - x);
+}
+
+#endif // HEIC_NEON_KERNELS
+
+
+swizzle_row_func
+get_swizzle_row_func(swizzle_kernel kernel)
+{
+	switch (kernel) {
+		case SWIZZLE_SCALAR:
+			return swizzle_row_scalar;
+
+#ifdef HEIC_X86_KERNELS
+		case SWIZZLE_SSE2:
+			if (__builtin_cpu_supports("sse2"))
+				return swizzle_row_sse2;
+			break;
+		case SWIZZLE_SSSE3:
+			if (__builtin_cpu_supports("ssse3"))
+				return swizzle_row_ssse3;
+			break;
+		case SWIZZLE_AVX2:
+			if (__builtin_cpu_supports("avx2"))
+				return swizzle_row_avx2;
+			break;
+#endif
+
+#ifdef HEIC_NEON_KERNELS
+		case SWIZZLE_NEON:
+			return swizzle_row_neon;
+#endif
+
+		default:
+			break;
+	}
+
+	return NULL;
+}
+
+
+swizzle_kernel
+best_swizzle_kernel()
+{
+	static const swizzle_kernel kPreferred[] = {
+		SWIZZLE_AVX2, SWIZZLE_NEON, SWIZZLE_SSSE3, SWIZZLE_SSE2
+	};
+
+	for (size_t i = 0; i < sizeof(kPreferred) / sizeof(kPreferred[0]); i++) {
+		if (get_swizzle_row_func(kPreferred[i]) != NULL)
+			return kPreferred[i];
+	}
+
+	return SWIZZLE_SCALAR;
+}
+
+
+const char*
+swizzle_kernel_name(swizzle_kernel kernel)
+{
+	switch (kernel) {
+		case SWIZZLE_SCALAR:
+			return "scalar";
+		case SWIZZLE_SSE2:
+			return "SSE2";
+		case SWIZZLE_SSSE3:
+			return "SSSE3";
+		case SWIZZLE_AVX2:
+			return "AVX2";
+		case SWIZZLE_NEON:
+			return "NEON";
+		default:
+			return "unknown";
+	}
+}
+
+
+void
+swizzle_rgba_to_bgra(const uint8 *src, size_t srcStride, uint8 *dest,
+	size_t destStride, int32 width, int32 height)
+{
+	// the CPU does not change while we are loaded, so pick the kernel once
+	static const swizzle_row_func sRowFunc
+		= get_swizzle_row_func(best_swizzle_kernel());
+
+	for (int32 y = 0; y < height; y++) {
+		sRowFunc(src, dest, width);
+		src += srcStride;
+		dest += destStride;
+	}
+}
+
+
+//	#pragma mark - converter family
+
+
+// Every source is read as 16 bit samples and every destination takes
+// what it needs from those; after inlining, the compiler folds the 8 bit
+// round trip away and each pairing gets its own branch free loop.
+// Sources above 8 bits are dithered on their way down to 8 bits, with an
+// ordered pattern that is anchored to the output image.
+
+// 4 x 4 Bayer matrix, scaled to thresholds within one 8 bit step
+static const uint16 kDitherThresholds[4][4] = {
+	{ 8, 136, 40, 168 },
+	{ 200, 72, 232, 104 },
+	{ 56, 184, 24, 152 },
+	{ 248, 120, 216, 88 }
+};
+
+
+// A threshold of 0 gives the 8 bit value nearest below, which for 8 bit
+// sources is exactly the value that was read
+static inline uint8
+quantize(uint16 sample, uint16 threshold)
+{
+	return (sample - (sample >> 8) + threshold) >> 8;
+}
+
+
+template<int kBits>
+static inline uint16
+read_sample(const uint8 *row, int32 index)
+{
+	if (kBits == 8)
+		return row[index] * 257;
+
+	uint16 value = B_LENDIAN_TO_HOST_INT16(((const uint16 *)row)[index]);
+	return (value << (16 - kBits)) | (value >> (2 * kBits - 16));
+}
+
+
+template<int kBits, int kChannels>
+struct pixel_reader {
+	static const int kSampleBits = kBits;
+
+	static inline void Read(const uint8 *row, int32 x, uint16 *pixel)
+	{
+		if (kChannels == 1) {
+			pixel[0] = pixel[1] = pixel[2] = read_sample<kBits>(row, x);
+			pixel[3] = 65535;
+			return;
+		}
+
+		pixel[0] = read_sample<kBits>(row, x * kChannels);
+		pixel[1] = read_sample<kBits>(row, x * kChannels + 1);
+		pixel[2] = read_sample<kBits>(row, x * kChannels + 2);
+		pixel[3] = kChannels == 4
+			? read_sample<kBits>(row, x * kChannels + 3) : 65535;
+	}
+};
+
+
+struct rgba32_writer {
+	static inline void Write(uint8 *row, int32 x, const uint16 *pixel,
+		uint16 threshold)
+	{
+		row[x * 4] = quantize(pixel[2], threshold);
+		row[x * 4 + 1] = quantize(pixel[1], threshold);
+		row[x * 4 + 2] = quantize(pixel[0], threshold);
+		row[x * 4 + 3] = quantize(pixel[3], 0);
+	}
+};
+
+
+struct rgb32_writer {
+	static inline void Write(uint8 *row, int32 x, const uint16 *pixel,
+		uint16 threshold)
+	{
+		row[x * 4] = quantize(pixel[2], threshold);
+		row[x * 4 + 1] = quantize(pixel[1], threshold);
+		row[x * 4 + 2] = quantize(pixel[0], threshold);
+		row[x * 4 + 3] = 255;
+	}
+};
+
+
+struct rgb24_writer {
+	static inline void Write(uint8 *row, int32 x, const uint16 *pixel,
+		uint16 threshold)
+	{
+		row[x * 3] = quantize(pixel[2], threshold);
+		row[x * 3 + 1] = quantize(pixel[1], threshold);
+		row[x * 3 + 2] = quantize(pixel[0], threshold);
+	}
+};
+
+
+struct gray8_writer {
+	static inline void Write(uint8 *row, int32 x, const uint16 *pixel,
+		uint16 /*threshold*/)
+	{
+		// BT.601 luma in Q16; the weights add up to one, so gray sources
+		// come through unchanged
+		row[x] = (19595 * (uint32)pixel[0] + 38470 * (uint32)pixel[1]
+			+ 7471 * (uint32)pixel[2] + 32768) >> 24;
+	}
+};
+
+
+struct rgba64_writer {
+	static inline void Write(uint8 *row, int32 x, const uint16 *pixel,
+		uint16 /*threshold*/)
+	{
+		uint16 *out = (uint16 *)row + x * 4;
+		out[0] = pixel[2];
+		out[1] = pixel[1];
+		out[2] = pixel[0];
+		out[3] = pixel[3];
+	}
+};
+
+
+template<class Reader, class Writer>
+static void
+convert_rows(const uint8 *src, size_t srcStride, uint8 *dest,
+	size_t destStride, int32 width, int32 height, int32 originX,
+	int32 originY)
+{
+	for (int32 y = 0; y < height; y++) {
+		const uint16 *thresholds = kDitherThresholds[(originY + y) & 3];
+		for (int32 x = 0; x < width; x++) {
+			uint16 pixel[4];
+			Reader::Read(src, x, pixel);
+			Writer::Write(dest, x, pixel,
+				Reader::kSampleBits > 8 ? thresholds[(originX + x) & 3] : 0);
+		}
+		src += srcStride;
+		dest += destStride;
+	}
+}
+
+
+#ifdef HEIC_X86_KERNELS
+
+// Dithers 10 and 12 bit RRGGBBAA down to B_RGBA32 or B_RGB32 four pixels
+// at a time, in 16 bit lanes with the same arithmetic as read_sample()
+// and quantize(); R and B trade places with a word shuffle.
+template<int kBits, bool kOpaque>
+__attribute__((target("sse2")))
+static void
+dither_rows_sse2(const uint8 *src, size_t srcStride, uint8 *dest,
+	size_t destStride, int32 width, int32 height, int32 originX,
+	int32 originY)
+{
+	typedef pixel_reader<kBits, 4> Reader;
+
+	const __m128i alpha = _mm_set1_epi32(kOpaque ? (int)0xff000000 : 0);
+
+	// Every vector starts at the same column of the pattern
+	int32 phase = originX & 3;
+
+	for (int32 y = 0; y < height; y++) {
+		const uint16 *t = kDitherThresholds[(originY + y) & 3];
+		uint16 t0 = t[phase];
+		uint16 t1 = t[(phase + 1) & 3];
+		uint16 t2 = t[(phase + 2) & 3];
+		uint16 t3 = t[(phase + 3) & 3];
+		const __m128i thresholdsLow = _mm_setr_epi16(t0, t0, t0, 0,
+			t1, t1, t1, 0);
+		const __m128i thresholdsHigh = _mm_setr_epi16(t2, t2, t2, 0,
+			t3, t3, t3, 0);
+
+#define QUANTIZE(v, thresholds) \
+		v = _mm_or_si128(_mm_slli_epi16(v, 16 - kBits), \
+			_mm_srli_epi16(v, 2 * kBits - 16)); \
+		v = _mm_srli_epi16(_mm_add_epi16(_mm_sub_epi16(v, \
+			_mm_srli_epi16(v, 8)), thresholds), 8); \
+		v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, \
+			_MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2))
+
+		int32 x = 0;
+		for (; x + 4 <= width; x += 4) {
+			__m128i low = _mm_loadu_si128((const __m128i *)(src + x * 8));
+			__m128i high = _mm_loadu_si128(
+				(const __m128i *)(src + x * 8 + 16));
+			QUANTIZE(low, thresholdsLow);
+			QUANTIZE(high, thresholdsHigh);
+			_mm_storeu_si128((__m128i *)(dest + x * 4),
+				_mm_or_si128(_mm_packus_epi16(low, high), alpha));
+		}
+
+#undef QUANTIZE
+
+		for (; x < width; x++) {
+			uint16 pixel[4];
+			Reader::Read(src, x, pixel);
+			if (kOpaque)
+				rgb32_writer::Write(dest, x, pixel, t[(originX + x) & 3]);
+			else
+				rgba32_writer::Write(dest, x, pixel, t[(originX + x) & 3]);
+		}
+
+		src += srcStride;
+		dest += destStride;
+	}
+}
+
+#endif // HEIC_X86_KERNELS
+
+
+// 8 bit RGBA is only reordered, there is nothing to dither
+static void
+swizzle_rows(const uint8 *src, size_t srcStride, uint8 *dest,
+	size_t destStride, int32 width, int32 height, int32 /*originX*/,
+	int32 /*originY*/)
+{
+	swizzle_rgba_to_bgra(src, srcStride, dest, destStride, width, height);
+}
+
+
+enum {
+	DEST_RGBA32 = 0,
+	DEST_RGB32,
+	DEST_RGB24,
+	DEST_GRAY8,
+	DEST_RGBA64,
+
+	DEST_COUNT
+};
+
+#define CONVERTERS(bits, channels) \
+	{ \
+		&convert_rows<pixel_reader<bits, channels>, rgba32_writer>, \
+		&convert_rows<pixel_reader<bits, channels>, rgb32_writer>, \
+		&convert_rows<pixel_reader<bits, channels>, rgb24_writer>, \
+		&convert_rows<pixel_reader<bits, channels>, gray8_writer>, \
+		&convert_rows<pixel_reader<bits, channels>, rgba64_writer> \
+	}
+
+// Indexed by pixel_source, then by the DEST_* constants
+static const convert_rows_func kConverters[PIXEL_SOURCE_COUNT][DEST_COUNT] = {
+	CONVERTERS(8, 3),
+	CONVERTERS(8, 4),
+	CONVERTERS(8, 1),
+	CONVERTERS(10, 3),
+	CONVERTERS(10, 4),
+	CONVERTERS(10, 1),
+	CONVERTERS(12, 3),
+	CONVERTERS(12, 4),
+	CONVERTERS(12, 1)
+};
+
+#undef CONVERTERS
+
+
+pixel_source
+get_pixel_source(int32 channels, int32 bits)
+{
+	int32 base;
+	switch (bits) {
+		case 8:
+			base = PIXEL_SOURCE_RGB8;
+			break;
+		case 10:
+			base = PIXEL_SOURCE_RGB10;
+			break;
+		case 12:
+			base = PIXEL_SOURCE_RGB12;
+			break;
+		default:
+			return PIXEL_SOURCE_COUNT;
+	}
+
+	switch (channels) {
+		case 3:
+			return (pixel_source)base;
+		case 4:
+			return (pixel_source)(base + 1);
+		case 1:
+			return (pixel_source)(base + 2);
+		default:
+			return PIXEL_SOURCE_COUNT;
+	}
+}
+
+
+uint32
+pixel_source_bytes(pixel_source source)
+{
+	// RGB, RGBA and gray repeat for each bit depth
+	static const uint32 kChannels[] = { 3, 4, 1 };
+	uint32 bytes = source >= PIXEL_SOURCE_RGB10 ? 2 : 1;
+	return kChannels[source % 3] * bytes;
+}
+
+
+convert_rows_func
+get_pixel_converter(pixel_source source, color_space dest)
+{
+	if (source < 0 || source >= PIXEL_SOURCE_COUNT)
+		return NULL;
+
+	// The vector kernels beat the generic loop for the common cases
+	if (source == PIXEL_SOURCE_RGBA8 && dest == B_RGBA32)
+		return &swizzle_rows;
+
+#ifdef HEIC_X86_KERNELS
+	if ((source == PIXEL_SOURCE_RGBA10 || source == PIXEL_SOURCE_RGBA12)
+		&& (dest == B_RGBA32 || dest == B_RGB32)
+		&& __builtin_cpu_supports("sse2")) {
+		if (source == PIXEL_SOURCE_RGBA10) {
+			return dest == B_RGBA32 ? &dither_rows_sse2<10, false>
+				: &dither_rows_sse2<10, true>;
+		}
+		return dest == B_RGBA32 ? &dither_rows_sse2<12, false>
+			: &dither_rows_sse2<12, true>;
+	}
+#endif
+
+	switch (dest) {
+		case B_RGBA32:
+			return kConverters[source][DEST_RGBA32];
+		case B_RGB32:
+			return kConverters[source][DEST_RGB32];
+		case B_RGB24:
+			return kConverters[source][DEST_RGB24];
+		case B_GRAY8:
+			return kConverters[source][DEST_GRAY8];
+		case B_RGBA64:
+			return kConverters[source][DEST_RGBA64];
+		default:
+			return NULL;
+	}
+}
+
+
+//	#pragma mark - Y'CbCr
+
+
+static const int32 kYCbCrShift = 13;
+
+
+static inline uint8
+clamp8(int32 value)
+{
+	if (value < 0)
+		return 0;
+	if (value > 255)
+		return 255;
+	return value;
+}
+
+
+static inline void
+ycbcr_pixel(int32 y, int32 cb, int32 cr, uint8 alpha,
+	const ycbcr_coefficients &c, uint8 *dest)
+{
+	y = (y - c.yOffset) * c.yScale + (1 << (kYCbCrShift - 1));
+	cb -= 128;
+	cr -= 128;
+
+	dest[0] = clamp8((y + cb * c.cbToBlue) >> kYCbCrShift);
+	dest[1] = clamp8((y + cb * c.cbToGreen + cr * c.crToGreen) >> kYCbCrShift);
+	dest[2] = clamp8((y + cr * c.crToRed) >> kYCbCrShift);
+	dest[3] = alpha;
+}
+
+
+static void
+ycbcr_row_scalar(const uint8 *y, const uint8 *cb, const uint8 *cr,
+	const uint8 *alpha, uint8 *dest, int32 first, int32 width, int32 shiftX,
+	const ycbcr_coefficients &c)
+{
+	for (int32 x = first; x < width; x++) {
+		int32 chroma = x >> shiftX;
+		ycbcr_pixel(y[x], cb[chroma], cr[chroma],
+			alpha != NULL ? alpha[x] : 255, c, dest + x * 4);
+	}
+}
+
+
+#ifdef HEIC_X86_KERNELS
+
+__attribute__((target("sse2")))
+static inline __m128i
+load_chroma_sse2(const uint8 *plane, int32 x, int32 shiftX)
+{
+	const __m128i zero = _mm_setzero_si128();
+	if (shiftX == 0) {
+		return _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)(plane + x)), zero);
+	}
+
+	// four samples cover eight pixels, duplicate every one of them
+	int32 samples;
+	memcpy(&samples, plane + x / 2, sizeof(samples));
+	__m128i chroma = _mm_cvtsi32_si128(samples);
+	return _mm_unpacklo_epi8(_mm_unpacklo_epi8(chroma, chroma), zero);
+}
+
+
+__attribute__((target("sse2")))
+static void
+ycbcr_row_sse2(const uint8 *y, const uint8 *cb, const uint8 *cr,
+	const uint8 *alpha, uint8 *dest, int32 width, int32 shiftX,
+	const ycbcr_coefficients &c)
+{
+	// Every channel is a pmaddwd of (sample, 1) or (cb, cr) pairs with
+	// the matching coefficient pairs, which is exactly the scalar math
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i chromaBias = _mm_set1_epi16(128);
+	const __m128i yOffset = _mm_set1_epi16(c.yOffset);
+	const __m128i opaque = _mm_set1_epi8((char)0xff);
+	const __m128i yFactors = _mm_set1_epi32(
+		(1 << (kYCbCrShift - 1)) << 16 | (uint16)c.yScale);
+	const __m128i redFactors = _mm_set1_epi32(
+		(int32)((uint32)(uint16)c.crToRed << 16));
+	const __m128i greenFactors = _mm_set1_epi32(
+		(int32)((uint32)(uint16)c.crToGreen << 16 | (uint16)c.cbToGreen));
+	const __m128i blueFactors = _mm_set1_epi32((uint16)c.cbToBlue);
+
+	int32 x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m128i luma = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)(y + x)), zero), yOffset);
+		__m128i blue = _mm_sub_epi16(load_chroma_sse2(cb, x, shiftX),
+			chromaBias);
+		__m128i red = _mm_sub_epi16(load_chroma_sse2(cr, x, shiftX),
+			chromaBias);
+
+		__m128i lumaLow = _mm_madd_epi16(_mm_unpacklo_epi16(luma, one),
+			yFactors);
+		__m128i lumaHigh = _mm_madd_epi16(_mm_unpackhi_epi16(luma, one),
+			yFactors);
+		__m128i chromaLow = _mm_unpacklo_epi16(blue, red);
+		__m128i chromaHigh = _mm_unpackhi_epi16(blue, red);
+
+#define CHANNEL(factors) \
+		_mm_packs_epi32( \
+			_mm_srai_epi32(_mm_add_epi32(lumaLow, \
+				_mm_madd_epi16(chromaLow, factors)), kYCbCrShift), \
+			_mm_srai_epi32(_mm_add_epi32(lumaHigh, \
+				_mm_madd_epi16(chromaHigh, factors)), kYCbCrShift))
+
+		__m128i b = CHANNEL(blueFactors);
+		__m128i g = CHANNEL(greenFactors);
+		__m128i r = CHANNEL(redFactors);
+#undef CHANNEL
+
+		b = _mm_packus_epi16(b, b);
+		g = _mm_packus_epi16(g, g);
+		r = _mm_packus_epi16(r, r);
+		__m128i a = alpha != NULL
+			? _mm_loadl_epi64((const __m128i *)(alpha + x)) : opaque;
+
+		__m128i blueGreen = _mm_unpacklo_epi8(b, g);
+		__m128i redAlpha = _mm_unpacklo_epi8(r, a);
+		_mm_storeu_si128((__m128i *)(dest + x * 4),
+			_mm_unpacklo_epi16(blueGreen, redAlpha));
+		_mm_storeu_si128((__m128i *)(dest + x * 4 + 16),
+			_mm_unpackhi_epi16(blueGreen, redAlpha));
+	}
+
+	ycbcr_row_scalar(y, cb, cr, alpha, dest, x, width, shiftX, c);
+}
+
+#endif // HEIC_X86_KERNELS
+
+
+void
+compute_ycbcr_coefficients(double kr, double kb, bool fullRange,
+	ycbcr_coefficients &coefficients)
+{
+	double kg = 1.0 - kr - kb;
+	double lumaScale = fullRange ? 1.0 : 255.0 / 219.0;
+	double chromaScale = fullRange ? 1.0 : 255.0 / 224.0;
+	double one = 1 << kYCbCrShift;
+
+	coefficients.yOffset = fullRange ? 0 : 16;
+	coefficients.yScale = lround(lumaScale * one);
+	coefficients.crToRed = lround(2.0 * (1.0 - kr) * chromaScale * one);
+	coefficients.cbToGreen = lround(-2.0 * kb * (1.0 - kb) / kg
+		* chromaScale * one);
+	coefficients.crToGreen = lround(-2.0 * kr * (1.0 - kr) / kg
+		* chromaScale * one);
+	coefficients.cbToBlue = lround(2.0 * (1.0 - kb) * chromaScale * one);
+}
+
+
+void
+ycbcr_to_bgra(const ycbcr_planes &planes,
+	const ycbcr_coefficients &coefficients, int32 firstRow, int32 rowCount,
+	uint8 *dest, size_t destStride)
+{
+	bool useSSE2 = false;
+#ifdef HEIC_X86_KERNELS
+	useSSE2 = __builtin_cpu_supports("sse2");
+#endif
+
+	for (int32 row = firstRow; row < firstRow + rowCount; row++) {
+		int32 chromaRow = row >> planes.chromaShiftY;
+		const uint8 *y = planes.y + row * planes.yStride;
+		const uint8 *cb = planes.cb + chromaRow * planes.cbStride;
+		const uint8 *cr = planes.cr + chromaRow * planes.crStride;
+		const uint8 *alpha = planes.alpha != NULL
+			? planes.alpha + row * planes.alphaStride : NULL;
+
+#ifdef HEIC_X86_KERNELS
+		if (useSSE2) {
+			ycbcr_row_sse2(y, cb, cr, alpha, dest, planes.width,
+				planes.chromaShiftX, coefficients);
+		} else
+#endif
+		{
+			ycbcr_row_scalar(y, cb, cr, alpha, dest, 0, planes.width,
+				planes.chromaShiftX, coefficients);
+		}
+
+		dest += destStride;
+	}
+}
+
+
+uint32
+packed_ycbcr_row_bytes(color_space space, int32 width)
+{
+	// Groups of four pixels, rounded up to whole int32s like BBitmap does
+	uint32 groups = (width + 3) / 4;
+	uint32 rowBytes = space == B_YCbCr422 ? groups * 8 : groups * 6;
+	return (rowBytes + 3) & ~(uint32)3;
+}
+
+
+void
+pack_ycbcr(const ycbcr_planes &planes, color_space space, int32 firstRow,
+	int32 rowCount, uint8 *dest, size_t destStride)
+{
+	int32 width = planes.width;
+	int32 pairs = (width + 1) / 2;
+	int32 shiftX = planes.chromaShiftX;
+	size_t rowBytes = packed_ycbcr_row_bytes(space, width);
+
+	for (int32 row = firstRow; row < firstRow + rowCount; row++) {
+		int32 chromaRow = row >> planes.chromaShiftY;
+		const uint8 *y = planes.y + row * planes.yStride;
+		const uint8 *cb = planes.cb != NULL
+			? planes.cb + chromaRow * planes.cbStride : NULL;
+		const uint8 *cr = planes.cr != NULL
+			? planes.cr + chromaRow * planes.crStride : NULL;
+		uint8 *out = dest;
+
+		if (space == B_YCbCr422) {
+			// Y0 Cb0 Y1 Cr0
+			for (int32 i = 0; i < pairs; i++) {
+				int32 x = i * 2;
+				*out++ = y[x];
+				*out++ = cb != NULL ? cb[x >> shiftX] : 128;
+				*out++ = y[min_c(x + 1, width - 1)];
+				*out++ = cr != NULL ? cr[x >> shiftX] : 128;
+			}
+		} else {
+			// Cb0 Y0 Y1 on even lines, Cr0 Y0 Y1 on odd ones
+			const uint8 *chroma = (row & 1) == 0 ? cb : cr;
+			for (int32 i = 0; i < pairs; i++) {
+				int32 x = i * 2;
+				*out++ = chroma != NULL ? chroma[x >> shiftX] : 128;
+				*out++ = y[x];
+				*out++ = y[min_c(x + 1, width - 1)];
+			}
+		}
+
+		memset(out, 0, rowBytes - (out - dest));
+		dest += destStride;
+	}
+}
+
+
+//	#pragma mark - colour management
+
+
+static inline int32
+clamp_linear(int32 value)
+{
+	return min_c(max_c(value, 0), (1 << kColorLinearBits) - 1);
+}
+
+
+static inline void
+color_pixel(const color_lut &lut, uint8 *pixel)
+{
+	int32 r = lut.toLinear[0][pixel[2]];
+	int32 g = lut.toLinear[1][pixel[1]];
+	int32 b = lut.toLinear[2][pixel[0]];
+	const int32 *m = lut.matrix;
+	const int32 round = 1 << (kColorMatrixShift - 1);
+
+	int32 red = (m[0] * r + m[1] * g + m[2] * b + round) >> kColorMatrixShift;
+	int32 green = (m[3] * r + m[4] * g + m[5] * b + round)
+		>> kColorMatrixShift;
+	int32 blue = (m[6] * r + m[7] * g + m[8] * b + round) >> kColorMatrixShift;
+
+	pixel[0] = lut.fromLinear[clamp_linear(blue)];
+	pixel[1] = lut.fromLinear[clamp_linear(green)];
+	pixel[2] = lut.fromLinear[clamp_linear(red)];
+}
+
+
+#ifdef HEIC_X86_KERNELS
+
+// Eight B_RGBA32 pixels at a time, with gathers for the table lookups;
+// the arithmetic is the same as color_pixel(), so are the results
+__attribute__((target("avx2")))
+static void
+color_row_avx2(const color_lut &lut, uint8 *row, int32 width)
+{
+	const __m256i byteMask = _mm256_set1_epi32(0xff);
+	const __m256i alphaMask = _mm256_set1_epi32((int)0xff000000);
+	const __m256i round = _mm256_set1_epi32(1 << (kColorMatrixShift - 1));
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i maxLinear = _mm256_set1_epi32((1 << kColorLinearBits) - 1);
+	__m256i m[9];
+	for (int32 i = 0; i < 9; i++)
+		m[i] = _mm256_set1_epi32(lut.matrix[i]);
+
+#define CHANNEL(i) \
+	_mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32( \
+		_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(m[i], r), \
+			_mm256_mullo_epi32(m[i + 1], g)), \
+		_mm256_add_epi32(_mm256_mullo_epi32(m[i + 2], b), round)), \
+		kColorMatrixShift), zero), maxLinear)
+
+	const int *fromLinear = (const int *)lut.fromLinear;
+	int32 x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m256i pixels = _mm256_loadu_si256((const __m256i *)(row + x * 4));
+		__m256i b = _mm256_and_si256(pixels, byteMask);
+		__m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), byteMask);
+		__m256i r = _mm256_and_si256(_mm256_srli_epi32(pixels, 16),
+			byteMask);
+		r = _mm256_i32gather_epi32(lut.toLinear[0], r, 4);
+		g = _mm256_i32gather_epi32(lut.toLinear[1], g, 4);
+		b = _mm256_i32gather_epi32(lut.toLinear[2], b, 4);
+
+		__m256i red = _mm256_i32gather_epi32(fromLinear, CHANNEL(0), 1);
+		__m256i green = _mm256_i32gather_epi32(fromLinear, CHANNEL(3), 1);
+		__m256i blue = _mm256_i32gather_epi32(fromLinear, CHANNEL(6), 1);
+
+		__m256i result = _mm256_or_si256(
+			_mm256_or_si256(_mm256_and_si256(blue, byteMask),
+				_mm256_slli_epi32(_mm256_and_si256(green, byteMask), 8)),
+			_mm256_or_si256(
+				_mm256_slli_epi32(_mm256_and_si256(red, byteMask), 16),
+				_mm256_and_si256(pixels, alphaMask)));
+		_mm256_storeu_si256((__m256i *)(row + x * 4), result);
+	}
+
+#undef CHANNEL
+
+	for (; x < width; x++)
+		color_pixel(lut, row + x * 4);
+}
+
+#endif // HEIC_X86_KERNELS
+
+
+void
+apply_color_lut(const color_lut &lut, uint8 *rows, size_t stride,
+	int32 width, int32 height, uint32 pixelBytes)
+{
+#ifdef HEIC_X86_KERNELS
+	static const bool sHasAVX2 = __builtin_cpu_supports("avx2");
+	if (pixelBytes == 4 && sHasAVX2) {
+		for (int32 y = 0; y < height; y++)
+			color_row_avx2(lut, rows + y * stride, width);
+		return;
+	}
+#endif
+
+	for (int32 y = 0; y < height; y++) {
+		uint8 *pixel = rows + y * stride;
+		for (int32 x = 0; x < width; x++) {
+			color_pixel(lut, pixel);
+			pixel += pixelBytes;
+		}
+	}
+}
+
+
+//	#pragma mark - downsampling
+
+
+static void
+downsample_row_scalar(const uint8 *top, const uint8 *bottom, uint8 *dest,
+	int32 first, int32 sourceWidth, uint32 pixelBytes)
+{
+	int32 width = downsampled_size(sourceWidth);
+	for (int32 x = first; x < width; x++) {
+		const uint32 left = x * 2 * pixelBytes;
+		const uint32 right = min_c(x * 2 + 1, sourceWidth - 1) * pixelBytes;
+		for (uint32 i = 0; i < pixelBytes; i++) {
+			dest[x * pixelBytes + i] = (top[left + i] + top[right + i]
+				+ bottom[left + i] + bottom[right + i] + 2) >> 2;
+		}
+	}
+}
+
+
+#ifdef HEIC_X86_KERNELS
+
+// Eight four byte pixels of each row make four output pixels; the sums
+// are taken in 16 bit lanes, so the results match the scalar code
+__attribute__((target("sse2")))
+static void
+downsample_row_sse2(const uint8 *top, const uint8 *bottom, uint8 *dest,
+	int32 sourceWidth)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+
+	int32 width = downsampled_size(sourceWidth);
+	int32 x = 0;
+	for (; x + 4 <= width; x += 4) {
+		__m128i top0 = _mm_loadu_si128((const __m128i *)(top + x * 8));
+		__m128i top1 = _mm_loadu_si128((const __m128i *)(top + x * 8 + 16));
+		__m128i bottom0 = _mm_loadu_si128((const __m128i *)(bottom + x * 8));
+		__m128i bottom1 = _mm_loadu_si128(
+			(const __m128i *)(bottom + x * 8 + 16));
+
+		// Columns first, then the neighbouring pixels of each pair
+		__m128i sum0 = _mm_add_epi16(_mm_unpacklo_epi8(top0, zero),
+			_mm_unpacklo_epi8(bottom0, zero));
+		__m128i sum1 = _mm_add_epi16(_mm_unpackhi_epi8(top0, zero),
+			_mm_unpackhi_epi8(bottom0, zero));
+		__m128i sum2 = _mm_add_epi16(_mm_unpacklo_epi8(top1, zero),
+			_mm_unpacklo_epi8(bottom1, zero));
+		__m128i sum3 = _mm_add_epi16(_mm_unpackhi_epi8(top1, zero),
+			_mm_unpackhi_epi8(bottom1, zero));
+
+		__m128i low = _mm_add_epi16(_mm_unpacklo_epi64(sum0, sum1),
+			_mm_unpackhi_epi64(sum0, sum1));
+		__m128i high = _mm_add_epi16(_mm_unpacklo_epi64(sum2, sum3),
+			_mm_unpackhi_epi64(sum2, sum3));
+		low = _mm_srli_epi16(_mm_add_epi16(low, two), 2);
+		high = _mm_srli_epi16(_mm_add_epi16(high, two), 2);
+
+		_mm_storeu_si128((__m128i *)(dest + x * 4),
+			_mm_packus_epi16(low, high));
+	}
+
+	downsample_row_scalar(top, bottom, dest, x, sourceWidth, 4);
+}
+
+#endif // HEIC_X86_KERNELS
+
+
+int32
+downsampled_size(int32 size)
+{
+	return max_c(size / 2, 1);
+}
+
+
+void
+downsample_row(const uint8 *top, const uint8 *bottom, uint8 *dest,
+	int32 sourceWidth, uint32 pixelBytes)
+{
+#ifdef HEIC_X86_KERNELS
+	static const bool sHasSSE2 = __builtin_cpu_supports("sse2");
+	if (pixelBytes == 4 && sHasSSE2) {
+		downsample_row_sse2(top, bottom, dest, sourceWidth);
+		return;
+	}
+#endif
+
+	downsample_row_scalar(top, bottom, dest, 0, sourceWidth, pixelBytes);
+}
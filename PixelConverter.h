@@ -0,0 +1,163 @@
+/*
+ * PixelConverter.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef PIXELCONVERTER_H
+#define PIXELCONVERTER_H
+
+
+#include <GraphicsDefs.h>
+#include <SupportDefs.h>
+
+
+// Row kernels that turn libheif's interleaved RGBA into the BGRA byte
+// order of B_RGBA32. The scalar kernel is the reference implementation;
+// the vector kernels only process whole vectors and leave the remainder
+// of the row to it.
+enum swizzle_kernel {
+	SWIZZLE_SCALAR = 0,
+	SWIZZLE_SSE2,
+	SWIZZLE_SSSE3,
+	SWIZZLE_AVX2,
+	SWIZZLE_NEON,
+
+	SWIZZLE_KERNEL_COUNT
+};
+
+typedef void (*swizzle_row_func)(const uint8 *src, uint8 *dest, int32 pixels);
+
+
+swizzle_row_func	get_swizzle_row_func(swizzle_kernel kernel);
+	// returns NULL if the kernel is not built in or not supported
+	// by the CPU we are running on
+swizzle_kernel		best_swizzle_kernel();
+const char*			swizzle_kernel_name(swizzle_kernel kernel);
+
+void				swizzle_rgba_to_bgra(const uint8 *src, size_t srcStride,
+						uint8 *dest, size_t destStride, int32 width,
+						int32 height);
+	// converts a whole image using the best kernel; the strides may
+	// be larger than width * 4
+
+// Interleaved layouts libheif decodes to. Above 8 bits these are the
+// little endian 16 bit samples of heif_chroma_interleaved_RRGGBB(AA)_LE
+// and of monochrome planes.
+enum pixel_source {
+	PIXEL_SOURCE_RGB8 = 0,
+	PIXEL_SOURCE_RGBA8,
+	PIXEL_SOURCE_GRAY8,
+	PIXEL_SOURCE_RGB10,
+	PIXEL_SOURCE_RGBA10,
+	PIXEL_SOURCE_GRAY10,
+	PIXEL_SOURCE_RGB12,
+	PIXEL_SOURCE_RGBA12,
+	PIXEL_SOURCE_GRAY12,
+
+	PIXEL_SOURCE_COUNT
+};
+
+typedef void (*convert_rows_func)(const uint8 *src, size_t srcStride,
+	uint8 *dest, size_t destStride, int32 width, int32 height,
+	int32 originX, int32 originY);
+	// originX and originY place the first pixel in the output image, so
+	// that the dither pattern lines up across calls and does not depend
+	// on how the image is split between them. A run that ends up written
+	// backwards passes the negated position of its last pixel instead.
+
+pixel_source		get_pixel_source(int32 channels, int32 bits);
+	// channels is 1, 3 or 4; returns PIXEL_SOURCE_COUNT for anything
+	// else, and for bit depths other than 8, 10 and 12
+uint32				pixel_source_bytes(pixel_source source);
+convert_rows_func	get_pixel_converter(pixel_source source,
+						color_space dest);
+	// returns a converter specialised for the pair, or NULL if dest is
+	// not one of B_RGBA32, B_RGB32, B_RGB24, B_GRAY8 and B_RGBA64; look
+	// it up once per image
+
+
+// Fixed point (Q13) coefficients for turning 8 bit Y'CbCr into R'G'B'
+struct ycbcr_coefficients {
+	int16				yOffset;
+	int16				yScale;
+	int16				crToRed;
+	int16				cbToGreen;
+	int16				crToGreen;
+	int16				cbToBlue;
+};
+
+// The planes of a decoded 8 bit Y'CbCr image as libheif returns them
+struct ycbcr_planes {
+	const uint8			*y;
+	const uint8			*cb;
+	const uint8			*cr;
+		// NULL for monochrome images, only pack_ycbcr() accepts those
+	const uint8			*alpha;
+		// NULL for opaque images
+	size_t				yStride;
+	size_t				cbStride;
+	size_t				crStride;
+	size_t				alphaStride;
+	int32				width;
+	int32				height;
+	int32				chromaShiftX;
+	int32				chromaShiftY;
+		// 1 where the chroma planes are subsampled, 4:2:0 has both
+};
+
+
+void				compute_ycbcr_coefficients(double kr, double kb,
+						bool fullRange, ycbcr_coefficients &coefficients);
+	// kr and kb are the luma weights of the matrix, as in H.273
+
+void				ycbcr_to_bgra(const ycbcr_planes &planes,
+						const ycbcr_coefficients &coefficients,
+						int32 firstRow, int32 rowCount, uint8 *dest,
+						size_t destStride);
+	// upsamples the chroma (nearest neighbour), applies the matrix and
+	// packs B_RGBA32 in a single pass over the planes
+
+uint32				packed_ycbcr_row_bytes(color_space space, int32 width);
+	// the row size BBitmap uses for B_YCbCr422 and B_YCbCr420
+void				pack_ycbcr(const ycbcr_planes &planes, color_space space,
+						int32 firstRow, int32 rowCount, uint8 *dest,
+						size_t destStride);
+	// repacks the planes into the interleaved B_YCbCr422 or B_YCbCr420
+	// layout, picking the nearest chroma sample; there is no colour
+	// conversion, rows are padded with zeros
+
+
+
+// Turns 8 bit R'G'B' of some colour space into sRGB through linear
+// light: a curve per channel, a 3x3 matrix and the sRGB curve
+const int32 kColorLinearBits = 14;
+const int32 kColorMatrixShift = 14;
+
+struct color_lut {
+	int32				toLinear[3][256];
+		// for R, G and B, linear light with kColorLinearBits
+	int32				matrix[9];
+		// row major, source to sRGB primaries, Q14
+	uint8				fromLinear[(1 << kColorLinearBits) + 4];
+		// the sRGB curve, padded for 32 bit gathers
+};
+
+void				apply_color_lut(const color_lut &lut, uint8 *rows,
+						size_t stride, int32 width, int32 height,
+						uint32 pixelBytes);
+	// converts B_RGBA32 or B_RGB32 (pixelBytes 4) and B_RGB24 (3) rows
+	// in place, alpha is left alone
+
+
+int32				downsampled_size(int32 size);
+	// half of size rounded down, but at least 1
+void				downsample_row(const uint8 *top, const uint8 *bottom,
+						uint8 *dest, int32 sourceWidth, uint32 pixelBytes);
+	// averages 2 x 2 blocks of two rows of 8 bit channels into one row
+	// of downsampled_size(sourceWidth) pixels; an odd last column is
+	// dropped, a single one is averaged with itself
+
+#endif // PIXELCONVERTER_H
@@ -0,0 +1,211 @@
+/*
+ * PositionIOReader.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "PositionIOReader.h"
+
+#include <Autolock.h>
+#include <new>
+#include <string.h>
+
+
+const heif_reader PositionIOReader::sReader = {
+	1,
+	&PositionIOReader::_GetPosition,
+	&PositionIOReader::_Read,
+	&PositionIOReader::_Seek,
+	&PositionIOReader::_WaitForFileSize
+};
+
+
+PositionIOReader::PositionIOReader(BPositionIO *stream, size_t blockSize,
+	int32 blockCount)
+	:
+	fLock("heic reader"),
+	fStream(stream),
+	fSize(0),
+	fPosition(0),
+	fBytesRead(0),
+	fBlockSize(blockSize),
+	fBlockCount(blockCount),
+	fBlocks(NULL),
+	fUseCounter(0),
+	fStatus(B_NO_INIT)
+{
+	if (stream->GetSize(&fSize) != B_OK) {
+		fSize = stream->Seek(0, SEEK_END);
+		if (fSize < 0) {
+			fStatus = fSize;
+			return;
+		}
+	}
+	if (fSize == 0) {
+		fStatus = B_NO_TRANSLATOR;
+		return;
+	}
+
+	fBlocks = new(std::nothrow) block[fBlockCount];
+	if (fBlocks == NULL) {
+		fStatus = B_NO_MEMORY;
+		return;
+	}
+
+	for (int32 i = 0; i < fBlockCount; i++) {
+		fBlocks[i].index = -1;
+		fBlocks[i].length = 0;
+		fBlocks[i].lastUse = 0;
+		fBlocks[i].data = NULL;
+	}
+
+	fStatus = B_OK;
+}
+
+
+PositionIOReader::~PositionIOReader()
+{
+	if (fBlocks != NULL) {
+		for (int32 i = 0; i < fBlockCount; i++)
+			delete[] fBlocks[i].data;
+		delete[] fBlocks;
+	}
+}
+
+
+status_t
+PositionIOReader::ReadInto(heif_context *context)
+{
+	if (fStatus != B_OK)
+		return fStatus;
+
+	fPosition = 0;
+	heif_error error = heif_context_read_from_reader(context, &sReader,
+		this, NULL);
+	if (error.code != heif_error_Ok)
+		return B_NO_TRANSLATOR;
+
+	return B_OK;
+}
+
+
+/*static*/ int64_t
+PositionIOReader::_GetPosition(void *userData)
+{
+	PositionIOReader *reader = (PositionIOReader *)userData;
+	BAutolock _(reader->fLock);
+	return reader->fPosition;
+}
+
+
+/*static*/ int
+PositionIOReader::_Read(void *data, size_t size, void *userData)
+{
+	PositionIOReader *reader = (PositionIOReader *)userData;
+	BAutolock _(reader->fLock);
+	if (reader->_ReadAt(reader->fPosition, (uint8 *)data, size) != B_OK)
+		return 1;
+
+	reader->fPosition += size;
+	return 0;
+}
+
+
+/*static*/ int
+PositionIOReader::_Seek(int64_t position, void *userData)
+{
+	PositionIOReader *reader = (PositionIOReader *)userData;
+	BAutolock _(reader->fLock);
+	if (position < 0 || position > reader->fSize)
+		return 1;
+
+	reader->fPosition = position;
+	return 0;
+}
+
+
+/*static*/ heif_reader_grow_status
+PositionIOReader::_WaitForFileSize(int64_t targetSize, void *userData)
+{
+	PositionIOReader *reader = (PositionIOReader *)userData;
+	if (targetSize > reader->fSize)
+		return heif_reader_grow_status_size_beyond_eof;
+
+	return heif_reader_grow_status_size_reached;
+}
+
+
+status_t
+PositionIOReader::_ReadAt(off_t position, uint8 *buffer, size_t size)
+{
+	if (position + (off_t)size > fSize)
+		return B_BAD_VALUE;
+
+	// Item data is usually read in one go and only once, caching it
+	// would just evict the box headers
+	if (size >= fBlockSize * 2) {
+		ssize_t bytesRead = fStream->ReadAt(position, buffer, size);
+		if (bytesRead != (ssize_t)size)
+			return bytesRead < 0 ? bytesRead : B_ERROR;
+
+		fBytesRead += bytesRead;
+		return B_OK;
+	}
+
+	while (size > 0) {
+		block *cached = _GetBlock(position / fBlockSize);
+		if (cached == NULL)
+			return B_ERROR;
+
+		size_t offset = position % fBlockSize;
+		if (offset >= cached->length)
+			return B_ERROR;
+
+		size_t bytes = min_c(size, cached->length - offset);
+		memcpy(buffer, cached->data + offset, bytes);
+		buffer += bytes;
+		position += bytes;
+		size -= bytes;
+	}
+
+	return B_OK;
+}
+
+
+PositionIOReader::block*
+PositionIOReader::_GetBlock(off_t index)
+{
+	block *victim = &fBlocks[0];
+	for (int32 i = 0; i < fBlockCount; i++) {
+		if (fBlocks[i].index == index) {
+			fBlocks[i].lastUse = ++fUseCounter;
+			return &fBlocks[i];
+		}
+		if (fBlocks[i].lastUse < victim->lastUse)
+			victim = &fBlocks[i];
+	}
+
+	if (victim->data == NULL) {
+		victim->data = new(std::nothrow) uint8[fBlockSize];
+		if (victim->data == NULL)
+			return NULL;
+	}
+
+	off_t offset = index * fBlockSize;
+	size_t length = min_c((off_t)fBlockSize, fSize - offset);
+	ssize_t bytesRead = fStream->ReadAt(offset, victim->data, length);
+	if (bytesRead != (ssize_t)length) {
+		victim->index = -1;
+		victim->lastUse = 0;
+		return NULL;
+	}
+
+	fBytesRead += bytesRead;
+	victim->index = index;
+	victim->length = length;
+	victim->lastUse = ++fUseCounter;
+	return victim;
+}
@@ -0,0 +1,78 @@
+/*
+ * PositionIOReader.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef POSITIONIOREADER_H
+#define POSITIONIOREADER_H
+
+
+#include <DataIO.h>
+#include <Locker.h>
+#include <SupportDefs.h>
+#include <libheif/heif.h>
+
+
+// Lets libheif pull data from a BPositionIO on demand through its
+// heif_reader interface. Small reads, like the ones for the ftyp, meta
+// and iloc boxes, are served from a little LRU cache of fixed size
+// blocks; large item data reads go to the stream directly. libheif keeps
+// a single position in the stream, so threads decoding from the same
+// context take ReadLock() around each decode; the reader locks it too.
+class PositionIOReader {
+public:
+								PositionIOReader(BPositionIO *stream,
+									size_t blockSize = 64 * 1024,
+									int32 blockCount = 8);
+								~PositionIOReader();
+
+			status_t			InitCheck() const { return fStatus; }
+
+			status_t			ReadInto(heif_context *context);
+				// the reader must outlive the context
+
+			off_t				Size() const { return fSize; }
+			off_t				BytesRead() const { return fBytesRead; }
+				// bytes actually read from the stream so far
+
+			BLocker*			ReadLock() { return &fLock; }
+
+private:
+			struct block {
+				off_t			index;
+				size_t			length;
+				uint32			lastUse;
+				uint8			*data;
+			};
+
+	static	int64_t				_GetPosition(void *userData);
+	static	int					_Read(void *data, size_t size,
+									void *userData);
+	static	int					_Seek(int64_t position, void *userData);
+	static	heif_reader_grow_status	_WaitForFileSize(int64_t targetSize,
+									void *userData);
+
+			status_t			_ReadAt(off_t position, uint8 *buffer,
+									size_t size);
+			block*				_GetBlock(off_t index);
+
+	static	const heif_reader	sReader;
+
+			BLocker				fLock;
+				// guards the position and the blocks
+			BPositionIO			*fStream;
+			off_t				fSize;
+			off_t				fPosition;
+			off_t				fBytesRead;
+			size_t				fBlockSize;
+			int32				fBlockCount;
+			block				*fBlocks;
+			uint32				fUseCounter;
+			status_t			fStatus;
+};
+
+
+#endif // POSITIONIOREADER_H
@@ -0,0 +1,308 @@
+/*
+ * PyramidWriter.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "PyramidWriter.h"
+
+#include <ByteOrder.h>
+#include <new>
+#include <string.h>
+
+#include "HEICTranslator.h"
+#include "PixelConverter.h"
+
+
+static void
+swap_header(TranslatorBitmap &header, swap_action action)
+{
+	swap_data(B_UINT32_TYPE, &header.magic, sizeof(uint32), action);
+	swap_data(B_RECT_TYPE, &header.bounds, sizeof(BRect), action);
+	swap_data(B_UINT32_TYPE, &header.rowBytes, sizeof(uint32), action);
+	swap_data(B_UINT32_TYPE, &header.colors, sizeof(color_space), action);
+	swap_data(B_UINT32_TYPE, &header.dataSize, sizeof(uint32), action);
+}
+
+
+PyramidWriter::PyramidWriter(BPositionIO *target, int32 levels)
+	:
+	fTarget(target),
+	fLevels(levels),
+	fPosition(0),
+	fStatus(B_OK),
+	fHeaderBytes(0),
+	fDownsample(false),
+	fWidth(0),
+	fHeight(0),
+	fRowBytes(0),
+	fPixelBytes(0),
+	fRows(NULL),
+	fRowFill(0),
+	fRowCount(0),
+	fLevel(NULL),
+	fLevelWidth(0),
+	fLevelHeight(0),
+	fLevelRowBytes(0)
+{
+}
+
+
+PyramidWriter::~PyramidWriter()
+{
+	delete[] fRows;
+	delete[] fLevel;
+}
+
+
+ssize_t
+PyramidWriter::Write(const void *buffer, size_t size)
+{
+	if (fStatus != B_OK)
+		return fStatus;
+
+	ssize_t written = fTarget->Write(buffer, size);
+	if (written != (ssize_t)size) {
+		fStatus = written < 0 ? written : B_ERROR;
+		return fStatus;
+	}
+	fPosition += size;
+
+	const uint8 *bytes = (const uint8 *)buffer;
+	if (fHeaderBytes < sizeof(TranslatorBitmap)) {
+		size_t length = min_c(size, sizeof(TranslatorBitmap) - fHeaderBytes);
+		memcpy((uint8 *)&fHeader + fHeaderBytes, bytes, length);
+		fHeaderBytes += length;
+		bytes += length;
+		size -= length;
+
+		if (fHeaderBytes == sizeof(TranslatorBitmap)) {
+			fStatus = _ParseHeader();
+			if (fStatus != B_OK)
+				return fStatus;
+		}
+	}
+
+	if (!fDownsample)
+		return written;
+
+	while (size > 0 && fRowCount < fHeight) {
+		// Whole pairs of rows are taken straight from the buffer
+		if (fRowFill == 0 && (fRowCount & 1) == 0
+			&& fRowCount + 2 <= fHeight && size >= fRowBytes * 2) {
+			_AddRows(bytes, bytes + fRowBytes);
+			fRowCount += 2;
+			bytes += fRowBytes * 2;
+			size -= fRowBytes * 2;
+			continue;
+		}
+
+		uint8 *row = fRows + (fRowCount & 1) * fRowBytes;
+		size_t length = min_c(size, fRowBytes - fRowFill);
+		memcpy(row + fRowFill, bytes, length);
+		fRowFill += length;
+		bytes += length;
+		size -= length;
+
+		if (fRowFill == fRowBytes) {
+			if ((fRowCount & 1) != 0)
+				_AddRows(fRows, fRows + fRowBytes);
+			fRowCount++;
+			fRowFill = 0;
+		}
+	}
+
+	return written;
+}
+
+
+ssize_t
+PyramidWriter::ReadAt(off_t /*position*/, void * /*buffer*/,
+	size_t /*size*/)
+{
+	return B_NOT_SUPPORTED;
+}
+
+
+ssize_t
+PyramidWriter::WriteAt(off_t position, const void *buffer, size_t size)
+{
+	if (position != fPosition)
+		return B_NOT_SUPPORTED;
+
+	return Write(buffer, size);
+}
+
+
+off_t
+PyramidWriter::Seek(off_t position, uint32 seekMode)
+{
+	if ((seekMode == SEEK_SET && position == fPosition)
+		|| (seekMode == SEEK_CUR && position == 0))
+		return fPosition;
+
+	return B_NOT_SUPPORTED;
+}
+
+
+off_t
+PyramidWriter::Position() const
+{
+	return fPosition;
+}
+
+
+status_t
+PyramidWriter::Finish(BMessage *reply)
+{
+	if (fStatus != B_OK)
+		return fStatus;
+	if (fHeaderBytes < sizeof(TranslatorBitmap))
+		return B_ERROR;
+
+	if (reply != NULL) {
+		reply->RemoveName(HEIC_SETTING_PYRAMID_OFFSET);
+		reply->RemoveName(HEIC_SETTING_PYRAMID_BOUNDS);
+		reply->AddInt64(HEIC_SETTING_PYRAMID_OFFSET, 0);
+		reply->AddRect(HEIC_SETTING_PYRAMID_BOUNDS,
+			BRect(0, 0, fWidth - 1, fHeight - 1));
+	}
+
+	if (!fDownsample)
+		return B_OK;
+	if (fRowCount != fHeight)
+		return B_ERROR;
+
+	// A single row is averaged with itself
+	if (fHeight == 1)
+		_AddRows(fRows, fRows);
+
+	const uint8 *bits = fLevel;
+	int32 width = fLevelWidth;
+	int32 height = fLevelHeight;
+	size_t rowBytes = fLevelRowBytes;
+	status_t status = _WriteLevel(bits, width, height, rowBytes, reply);
+
+	for (int32 level = 2; level < fLevels && status == B_OK
+			&& (width > 1 || height > 1); level++) {
+		int32 nextWidth = downsampled_size(width);
+		int32 nextHeight = downsampled_size(height);
+		size_t nextRowBytes = (nextWidth * fPixelBytes + 3) & ~(size_t)3;
+		uint8 *next = new(std::nothrow) uint8[nextRowBytes * nextHeight];
+		if (next == NULL) {
+			status = B_NO_MEMORY;
+			break;
+		}
+		memset(next, 0, nextRowBytes * nextHeight);
+
+		for (int32 y = 0; y < nextHeight; y++) {
+			downsample_row(bits + min_c(y * 2, height - 1) * rowBytes,
+				bits + min_c(y * 2 + 1, height - 1) * rowBytes,
+				next + y * nextRowBytes, width, fPixelBytes);
+		}
+
+		if (bits != fLevel)
+			delete[] bits;
+		bits = next;
+		width = nextWidth;
+		height = nextHeight;
+		rowBytes = nextRowBytes;
+
+		status = _WriteLevel(bits, width, height, rowBytes, reply);
+	}
+
+	if (bits != fLevel)
+		delete[] bits;
+	return status;
+}
+
+
+status_t
+PyramidWriter::_ParseHeader()
+{
+	TranslatorBitmap header = fHeader;
+	swap_header(header, B_SWAP_BENDIAN_TO_HOST);
+	if (header.magic != B_TRANSLATOR_BITMAP)
+		return B_ERROR;
+
+	fWidth = (int32)(header.bounds.right - header.bounds.left) + 1;
+	fHeight = (int32)(header.bounds.bottom - header.bounds.top) + 1;
+	fRowBytes = header.rowBytes;
+	fHeader = header;
+
+	switch (header.colors) {
+		case B_RGBA32:
+		case B_RGB32:
+			fPixelBytes = 4;
+			break;
+		case B_RGB24:
+			fPixelBytes = 3;
+			break;
+		case B_GRAY8:
+			fPixelBytes = 1;
+			break;
+		default:
+			// written through, but only as the first level
+			return B_OK;
+	}
+
+	if (fLevels <= 1 || fWidth <= 0 || fHeight <= 0
+		|| (fWidth == 1 && fHeight == 1) || fRowBytes < fWidth * fPixelBytes)
+		return B_OK;
+
+	fLevelWidth = downsampled_size(fWidth);
+	fLevelHeight = downsampled_size(fHeight);
+	fLevelRowBytes = (fLevelWidth * fPixelBytes + 3) & ~(size_t)3;
+
+	fRows = new(std::nothrow) uint8[fRowBytes * 2];
+	fLevel = new(std::nothrow) uint8[fLevelRowBytes * fLevelHeight];
+	if (fRows == NULL || fLevel == NULL)
+		return B_NO_MEMORY;
+
+	// Clear the row padding
+	memset(fLevel, 0, fLevelRowBytes * fLevelHeight);
+
+	fDownsample = true;
+	return B_OK;
+}
+
+
+void
+PyramidWriter::_AddRows(const uint8 *top, const uint8 *bottom)
+{
+	// An odd last row is dropped
+	int32 y = fRowCount / 2;
+	if (y < fLevelHeight) {
+		downsample_row(top, bottom, fLevel + y * fLevelRowBytes, fWidth,
+			fPixelBytes);
+	}
+}
+
+
+status_t
+PyramidWriter::_WriteLevel(const uint8 *bits, int32 width, int32 height,
+	size_t rowBytes, BMessage *reply)
+{
+	if (reply != NULL) {
+		reply->AddInt64(HEIC_SETTING_PYRAMID_OFFSET, fPosition);
+		reply->AddRect(HEIC_SETTING_PYRAMID_BOUNDS,
+			BRect(0, 0, width - 1, height - 1));
+	}
+
+	TranslatorBitmap header = fHeader;
+	header.bounds.Set(0, 0, width - 1, height - 1);
+	header.rowBytes = rowBytes;
+	header.dataSize = rowBytes * height;
+	swap_header(header, B_SWAP_HOST_TO_BENDIAN);
+
+	ssize_t size = rowBytes * height;
+	if (fTarget->Write(&header, sizeof(header)) != sizeof(header)
+		|| fTarget->Write(bits, size) != size)
+		return B_ERROR;
+
+	fPosition += sizeof(header) + size;
+	return B_OK;
+}
@@ -0,0 +1,78 @@
+/*
+ * PyramidWriter.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef PYRAMIDWRITER_H
+#define PYRAMIDWRITER_H
+
+
+#include <DataIO.h>
+#include <GraphicsDefs.h>
+#include <Message.h>
+#include <TranslatorFormats.h>
+
+
+// Passes a B_TRANSLATOR_BITMAP stream through to its target and follows
+// it with smaller copies of the image, each half the size of the one
+// before. The first of them is box filtered two rows at a time while the
+// image streams by, so the image is decoded once and never held in
+// full; the rest are made from that one when the stream is finished.
+// Only images with 8 bit channels get more than the first level.
+class PyramidWriter : public BPositionIO {
+public:
+								PyramidWriter(BPositionIO *target,
+									int32 levels);
+	virtual						~PyramidWriter();
+
+	virtual	ssize_t				Write(const void *buffer, size_t size);
+	virtual	ssize_t				ReadAt(off_t position, void *buffer,
+									size_t size);
+	virtual	ssize_t				WriteAt(off_t position, const void *buffer,
+									size_t size);
+				// writing is sequential only
+	virtual	off_t				Seek(off_t position, uint32 seekMode);
+	virtual	off_t				Position() const;
+
+			status_t			Finish(BMessage *reply);
+				// writes the remaining levels; reply gets the offset from
+				// the start and the bounds of each of them
+
+private:
+			status_t			_ParseHeader();
+			void				_AddRows(const uint8 *top,
+									const uint8 *bottom);
+			status_t			_WriteLevel(const uint8 *bits, int32 width,
+									int32 height, size_t rowBytes,
+									BMessage *reply);
+
+			BPositionIO			*fTarget;
+			int32				fLevels;
+			off_t				fPosition;
+			status_t			fStatus;
+
+			TranslatorBitmap	fHeader;
+			size_t				fHeaderBytes;
+			bool				fDownsample;
+			int32				fWidth;
+			int32				fHeight;
+			size_t				fRowBytes;
+			uint32				fPixelBytes;
+
+			uint8				*fRows;
+				// the row being filled and the one before it
+			size_t				fRowFill;
+			int32				fRowCount;
+
+			uint8				*fLevel;
+				// the first level below the image
+			int32				fLevelWidth;
+			int32				fLevelHeight;
+			size_t				fLevelRowBytes;
+};
+
+
+#endif // PYRAMIDWRITER_H
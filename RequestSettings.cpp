@@ -0,0 +1,66 @@
+/*
+ * RequestSettings.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "RequestSettings.h"
+
+#include "shared/TranslatorSettings.h"
+
+#include <Message.h>
+#include <stdio.h>
+
+
+bool
+get_bool_option(BMessage *ioExtension, const char *name, bool defaultValue)
+{
+	bool value;
+	if (ioExtension != NULL && ioExtension->FindBool(name, &value) == B_OK)
+		return value;
+
+	return defaultValue;
+}
+
+
+int32
+get_int32_option(BMessage *ioExtension, const char *name,
+	int32 defaultValue)
+{
+	int32 value;
+	if (ioExtension != NULL && ioExtension->FindInt32(name, &value) == B_OK)
+		return value;
+
+	return defaultValue;
+}
+
+
+bool
+get_bool_setting(TranslatorSettings *settings, BMessage *ioExtension,
+	const char *name)
+{
+	bool value;
+	if (ioExtension != NULL && ioExtension->FindBool(name, &value) == B_OK)
+		return value;
+
+	char savedName[B_FIELD_NAME_LENGTH];
+	snprintf(savedName, sizeof(savedName), "%s" HEIC_SAVED_SUFFIX, name);
+	return settings->SetGetBool(savedName);
+}
+
+
+int32
+get_int32_setting(TranslatorSettings *settings, BMessage *ioExtension,
+	const char *name)
+{
+	int32 value;
+	if (ioExtension != NULL && ioExtension->FindInt32(name, &value) == B_OK)
+		return value;
+
+	char savedName[B_FIELD_NAME_LENGTH];
+	snprintf(savedName, sizeof(savedName), "%s" HEIC_SAVED_SUFFIX, name);
+	return settings->SetGetInt32(savedName);
+}
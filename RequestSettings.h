@@ -0,0 +1,43 @@
+/*
+ * RequestSettings.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef REQUESTSETTINGS_H
+#define REQUESTSETTINGS_H
+
+
+#include <SupportDefs.h>
+
+
+class BMessage;
+class TranslatorSettings;
+
+
+// The saved settings are kept under the name a request uses with this
+// appended. BaseTranslator stores whatever it finds in ioExtension under
+// the names of the saved settings as the add-on wide settings, so a
+// request that overrode them under those names would change them for all
+// later requests.
+#define HEIC_SAVED_SUFFIX	"/saved"
+#define HEIC_SAVED_SETTING(name)	name HEIC_SAVED_SUFFIX
+
+
+// Options that only concern one request, taken from its ioExtension alone
+bool	get_bool_option(BMessage *ioExtension, const char *name,
+			bool defaultValue = false);
+int32	get_int32_option(BMessage *ioExtension, const char *name,
+			int32 defaultValue = 0);
+
+// Settings that a request may override in its ioExtension, and that are
+// taken from the saved settings otherwise
+bool	get_bool_setting(TranslatorSettings *settings, BMessage *ioExtension,
+			const char *name);
+int32	get_int32_setting(TranslatorSettings *settings,
+			BMessage *ioExtension, const char *name);
+
+
+#endif // REQUESTSETTINGS_H
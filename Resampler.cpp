@@ -0,0 +1,499 @@
+/*
+ * Resampler.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "Resampler.h"
+
+#include <math.h>
+#include <new>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#	define HEIC_X86_KERNELS 1
+#	include <immintrin.h>
+#endif
+
+
+// Weights are fixed point with enough headroom that a sum of 8 bit
+// samples, including Lanczos' negative lobes, still fits an int32
+static const int32 kPrecisionBits = 32 - 8 - 2;
+
+
+static double
+box_filter(double x)
+{
+	return x > -0.5 && x <= 0.5 ? 1.0 : 0.0;
+}
+
+
+static double
+bilinear_filter(double x)
+{
+	x = fabs(x);
+	return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+
+static double
+sinc(double x)
+{
+	if (x == 0.0)
+		return 1.0;
+
+	x *= M_PI;
+	return sin(x) / x;
+}
+
+
+static double
+lanczos_filter(double x)
+{
+	return x > -3.0 && x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+
+static const struct {
+	double	(*function)(double);
+	double	support;
+} kFilters[] = {
+	{ box_filter, 0.5 },
+	{ bilinear_filter, 1.0 },
+	{ lanczos_filter, 3.0 }
+};
+
+
+static inline uint8
+clip8(int32 value)
+{
+	value = (value + (1 << (kPrecisionBits - 1))) >> kPrecisionBits;
+	if (value < 0)
+		return 0;
+	if (value > 255)
+		return 255;
+	return value;
+}
+
+
+// value * alpha / 255, rounded
+static inline uint8
+multiply_alpha(uint32 value, uint32 alpha)
+{
+	uint32 product = value * alpha + 128;
+	return (product + (product >> 8)) >> 8;
+}
+
+
+// Returns false, leaving dest alone, if every pixel of the row is opaque
+static bool
+premultiply_row(const uint8 *source, uint8 *dest, int32 width)
+{
+	int32 x = 0;
+	while (x < width && source[x * 4 + 3] == 255)
+		x++;
+	if (x == width)
+		return false;
+
+	for (x = 0; x < width; x++) {
+		uint32 alpha = source[3];
+		dest[0] = multiply_alpha(source[0], alpha);
+		dest[1] = multiply_alpha(source[1], alpha);
+		dest[2] = multiply_alpha(source[2], alpha);
+		dest[3] = alpha;
+		source += 4;
+		dest += 4;
+	}
+	return true;
+}
+
+
+static void
+unpremultiply_row(uint8 *row, int32 width)
+{
+	for (int32 x = 0; x < width; x++, row += 4) {
+		uint32 alpha = row[3];
+		if (alpha == 255)
+			continue;
+
+		for (int32 i = 0; i < 3; i++) {
+			row[i] = alpha == 0 ? 0
+				: min_c((row[i] * 255 + alpha / 2) / alpha, 255);
+		}
+	}
+}
+
+
+//	#pragma mark - filter passes
+
+
+// Filters a row of RGBA into a row of BGRA, this is where the swizzle
+// happens
+static void
+horizontal_pass_scalar(const uint8 *source, uint8 *dest, int32 destWidth,
+	const int32 *bounds, const int32 *weights, int32 taps)
+{
+	for (int32 x = 0; x < destWidth; x++) {
+		const uint8 *pixel = source + bounds[0] * 4;
+		int32 count = bounds[1];
+		int32 red = 0;
+		int32 green = 0;
+		int32 blue = 0;
+		int32 alpha = 0;
+
+		for (int32 tap = 0; tap < count; tap++) {
+			int32 weight = weights[tap];
+			red += pixel[0] * weight;
+			green += pixel[1] * weight;
+			blue += pixel[2] * weight;
+			alpha += pixel[3] * weight;
+			pixel += 4;
+		}
+
+		dest[0] = clip8(blue);
+		dest[1] = clip8(green);
+		dest[2] = clip8(red);
+		dest[3] = clip8(alpha);
+
+		dest += 4;
+		bounds += 2;
+		weights += taps;
+	}
+}
+
+
+// Sums count rows, rowBytes apart, into one
+static void
+vertical_pass_scalar(const uint8 *rows, size_t rowBytes, int32 count,
+	const int32 *weights, int32 *accumulator, uint8 *dest)
+{
+	memset(accumulator, 0, rowBytes * sizeof(int32));
+	for (int32 tap = 0; tap < count; tap++) {
+		const uint8 *line = rows + tap * rowBytes;
+		int32 weight = weights[tap];
+		for (size_t i = 0; i < rowBytes; i++)
+			accumulator[i] += line[i] * weight;
+	}
+
+	for (size_t i = 0; i < rowBytes; i++)
+		dest[i] = clip8(accumulator[i]);
+}
+
+
+#ifdef HEIC_X86_KERNELS
+
+// Rounds and clips four sums like clip8() does and packs them into bytes
+__attribute__((target("sse4.1")))
+static inline __m128i
+round_sums_sse41(__m128i sums)
+{
+	const __m128i half = _mm_set1_epi32(1 << (kPrecisionBits - 1));
+	return _mm_srai_epi32(_mm_add_epi32(sums, half), kPrecisionBits);
+}
+
+
+// One pixel at a time, with its four channels in the lanes of a vector
+__attribute__((target("sse4.1")))
+static void
+horizontal_pass_sse41(const uint8 *source, uint8 *dest, int32 destWidth,
+	const int32 *bounds, const int32 *weights, int32 taps)
+{
+	for (int32 x = 0; x < destWidth; x++) {
+		const uint8 *pixel = source + bounds[0] * 4;
+		int32 count = bounds[1];
+		__m128i sums = _mm_setzero_si128();
+
+		for (int32 tap = 0; tap < count; tap++) {
+			int32 value;
+			memcpy(&value, pixel, sizeof(value));
+			sums = _mm_add_epi32(sums, _mm_mullo_epi32(
+				_mm_cvtepu8_epi32(_mm_cvtsi32_si128(value)),
+				_mm_set1_epi32(weights[tap])));
+			pixel += 4;
+		}
+
+		sums = round_sums_sse41(_mm_shuffle_epi32(sums,
+			_MM_SHUFFLE(3, 0, 1, 2)));
+		sums = _mm_packs_epi32(sums, sums);
+		int32 result = _mm_cvtsi128_si32(_mm_packus_epi16(sums, sums));
+		memcpy(dest, &result, sizeof(result));
+
+		dest += 4;
+		bounds += 2;
+		weights += taps;
+	}
+}
+
+
+// Sixteen bytes at a time, summed over all rows in registers
+__attribute__((target("sse4.1")))
+static void
+vertical_pass_sse41(const uint8 *rows, size_t rowBytes, int32 count,
+	const int32 *weights, int32 * /*accumulator*/, uint8 *dest)
+{
+	size_t i = 0;
+	for (; i + 16 <= rowBytes; i += 16) {
+		__m128i sums0 = _mm_setzero_si128();
+		__m128i sums1 = _mm_setzero_si128();
+		__m128i sums2 = _mm_setzero_si128();
+		__m128i sums3 = _mm_setzero_si128();
+
+		const uint8 *line = rows + i;
+		for (int32 tap = 0; tap < count; tap++) {
+			__m128i weight = _mm_set1_epi32(weights[tap]);
+			__m128i bytes = _mm_loadu_si128((const __m128i *)line);
+			sums0 = _mm_add_epi32(sums0, _mm_mullo_epi32(
+				_mm_cvtepu8_epi32(bytes), weight));
+			sums1 = _mm_add_epi32(sums1, _mm_mullo_epi32(
+				_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4)), weight));
+			sums2 = _mm_add_epi32(sums2, _mm_mullo_epi32(
+				_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8)), weight));
+			sums3 = _mm_add_epi32(sums3, _mm_mullo_epi32(
+				_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12)), weight));
+			line += rowBytes;
+		}
+
+		__m128i low = _mm_packs_epi32(round_sums_sse41(sums0),
+			round_sums_sse41(sums1));
+		__m128i high = _mm_packs_epi32(round_sums_sse41(sums2),
+			round_sums_sse41(sums3));
+		_mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(low, high));
+	}
+
+	for (; i < rowBytes; i++) {
+		int32 sum = 0;
+		for (int32 tap = 0; tap < count; tap++)
+			sum += rows[tap * rowBytes + i] * weights[tap];
+		dest[i] = clip8(sum);
+	}
+}
+
+#endif // HEIC_X86_KERNELS
+
+
+bool
+resample_kernel_supported(resample_kernel kernel)
+{
+	switch (kernel) {
+		case RESAMPLE_KERNEL_SCALAR:
+			return true;
+
+#ifdef HEIC_X86_KERNELS
+		case RESAMPLE_KERNEL_SSE41:
+			return __builtin_cpu_supports("sse4.1");
+#endif
+
+		default:
+			return false;
+	}
+}
+
+
+resample_kernel
+best_resample_kernel()
+{
+	return resample_kernel_supported(RESAMPLE_KERNEL_SSE41)
+		? RESAMPLE_KERNEL_SSE41 : RESAMPLE_KERNEL_SCALAR;
+}
+
+
+const char*
+resample_kernel_name(resample_kernel kernel)
+{
+	switch (kernel) {
+		case RESAMPLE_KERNEL_SCALAR:
+			return "scalar";
+		case RESAMPLE_KERNEL_SSE41:
+			return "SSE4.1";
+		default:
+			return "unknown";
+	}
+}
+
+
+//	#pragma mark - Resampler
+
+
+Resampler::Resampler(int32 sourceWidth, int32 sourceHeight, int32 destWidth,
+	int32 destHeight, resample_filter filter, resample_kernel kernel)
+	:
+	fSourceWidth(sourceWidth),
+	fSourceHeight(sourceHeight),
+	fDestWidth(destWidth),
+	fDestHeight(destHeight),
+	fFilter(filter),
+	fHorizontalPass(&horizontal_pass_scalar),
+	fVerticalPass(&vertical_pass_scalar),
+	fStatus(B_NO_INIT)
+{
+	fHorizontal.bounds = fHorizontal.weights = NULL;
+	fVertical.bounds = fVertical.weights = NULL;
+
+	if (sourceWidth <= 0 || sourceHeight <= 0 || destWidth <= 0
+		|| destHeight <= 0 || filter < RESAMPLE_BOX
+		|| filter > RESAMPLE_LANCZOS || !resample_kernel_supported(kernel)) {
+		fStatus = B_BAD_VALUE;
+		return;
+	}
+
+#ifdef HEIC_X86_KERNELS
+	if (kernel == RESAMPLE_KERNEL_SSE41) {
+		fHorizontalPass = &horizontal_pass_sse41;
+		fVerticalPass = &vertical_pass_sse41;
+	}
+#endif
+
+	fStatus = _ComputeCoefficients(sourceWidth, destWidth, fHorizontal);
+	if (fStatus == B_OK)
+		fStatus = _ComputeCoefficients(sourceHeight, destHeight, fVertical);
+}
+
+
+Resampler::~Resampler()
+{
+	delete[] fHorizontal.bounds;
+	delete[] fHorizontal.weights;
+	delete[] fVertical.bounds;
+	delete[] fVertical.weights;
+}
+
+
+size_t
+Resampler::ScratchSize(int32 rowCount) const
+{
+	if (fStatus != B_OK || rowCount <= 0)
+		return 0;
+
+	// The widest span of source rows any band of rowCount rows covers
+	rowCount = min_c(rowCount, fDestHeight);
+	int32 span = 0;
+	for (int32 first = 0; first + rowCount <= fDestHeight; first++) {
+		int32 last = first + rowCount - 1;
+		span = max_c(span, fVertical.bounds[last * 2]
+			+ fVertical.bounds[last * 2 + 1] - fVertical.bounds[first * 2]);
+	}
+
+	// The accumulator row comes first, then a source row premultiplied
+	// by its alpha, each rounded to keep what follows aligned
+	size_t size = fDestWidth * 4 * sizeof(int32)
+		+ ((fSourceWidth * 4 + 15) & ~(size_t)15) + span * fDestWidth * 4;
+	return (size + 15) & ~(size_t)15;
+}
+
+
+status_t
+Resampler::ResampleRows(const uint8 *source, size_t sourceStride,
+	int32 firstRow, int32 rowCount, uint8 *dest, size_t destStride,
+	uint8 *scratch) const
+{
+	if (fStatus != B_OK)
+		return fStatus;
+	if (firstRow < 0 || rowCount <= 0 || firstRow + rowCount > fDestHeight)
+		return B_BAD_VALUE;
+
+	// The filter windows move down monotonically, so the band needs the
+	// source rows from the first window's start to the last window's end
+	int32 lastRow = firstRow + rowCount - 1;
+	int32 sourceFirst = fVertical.bounds[firstRow * 2];
+	int32 sourceEnd = fVertical.bounds[lastRow * 2]
+		+ fVertical.bounds[lastRow * 2 + 1];
+
+	size_t rowBytes = fDestWidth * 4;
+	int32 *accumulator = (int32 *)scratch;
+	uint8 *premultiplied = scratch + rowBytes * sizeof(int32);
+	uint8 *rows = premultiplied + ((fSourceWidth * 4 + 15) & ~(size_t)15);
+
+	bool transparent = false;
+	for (int32 y = sourceFirst; y < sourceEnd; y++) {
+		const uint8 *row = source + y * sourceStride;
+		if (premultiply_row(row, premultiplied, fSourceWidth)) {
+			row = premultiplied;
+			transparent = true;
+		}
+
+		fHorizontalPass(row, rows + (y - sourceFirst) * rowBytes, fDestWidth,
+			fHorizontal.bounds, fHorizontal.weights, fHorizontal.taps);
+	}
+
+	// The vertical pass is a weighted sum of whole rows
+	for (int32 y = firstRow; y <= lastRow; y++) {
+		int32 first = fVertical.bounds[y * 2];
+		int32 count = fVertical.bounds[y * 2 + 1];
+		uint8 *out = dest + (y - firstRow) * destStride;
+
+		fVerticalPass(rows + (first - sourceFirst) * rowBytes, rowBytes,
+			count, fVertical.weights + y * fVertical.taps, accumulator, out);
+		if (transparent)
+			unpremultiply_row(out, fDestWidth);
+	}
+
+	return B_OK;
+}
+
+
+/*static*/ void
+Resampler::FitSize(int32 width, int32 height, int32 maxSize,
+	int32 &fitWidth, int32 &fitHeight)
+{
+	if (width >= height) {
+		fitWidth = maxSize;
+		fitHeight = max_c(1, (int32)(((int64)height * maxSize + width / 2)
+			/ width));
+	} else {
+		fitHeight = maxSize;
+		fitWidth = max_c(1, (int32)(((int64)width * maxSize + height / 2)
+			/ height));
+	}
+}
+
+
+status_t
+Resampler::_ComputeCoefficients(int32 sourceSize, int32 destSize,
+	coefficients &coefficients)
+{
+	double scale = (double)sourceSize / destSize;
+	double filterScale = max_c(scale, 1.0);
+	double support = kFilters[fFilter].support * filterScale;
+	int32 taps = (int32)ceil(support) * 2 + 1;
+
+	coefficients.taps = taps;
+	coefficients.bounds = new(std::nothrow) int32[destSize * 2];
+	coefficients.weights = new(std::nothrow) int32[destSize * taps];
+	double *kernel = new(std::nothrow) double[taps];
+	if (coefficients.bounds == NULL || coefficients.weights == NULL
+		|| kernel == NULL) {
+		delete[] kernel;
+		return B_NO_MEMORY;
+	}
+
+	for (int32 i = 0; i < destSize; i++) {
+		double center = (i + 0.5) * scale;
+		int32 first = max_c((int32)(center - support + 0.5), 0);
+		int32 count = min_c((int32)(center + support + 0.5), sourceSize)
+			- first;
+
+		double total = 0.0;
+		for (int32 tap = 0; tap < count; tap++) {
+			kernel[tap] = kFilters[fFilter].function(
+				(first + tap - center + 0.5) / filterScale);
+			total += kernel[tap];
+		}
+
+		int32 *weights = coefficients.weights + i * taps;
+		for (int32 tap = 0; tap < taps; tap++) {
+			double weight = tap < count && total != 0.0
+				? kernel[tap] / total * (1 << kPrecisionBits) : 0.0;
+			weights[tap] = (int32)(weight < 0.0 ? weight - 0.5 : weight + 0.5);
+		}
+
+		coefficients.bounds[i * 2] = first;
+		coefficients.bounds[i * 2 + 1] = count;
+	}
+
+	delete[] kernel;
+	return B_OK;
+}
+
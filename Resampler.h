@@ -0,0 +1,117 @@
+/*
+ * Resampler.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+
+#include <SupportDefs.h>
+
+
+enum resample_filter {
+	RESAMPLE_BOX = 0,
+	RESAMPLE_BILINEAR,
+	RESAMPLE_LANCZOS
+};
+
+
+// Implementations of the two filter passes. The scalar kernel is the
+// reference implementation; the vector kernels give the same results bit
+// for bit.
+enum resample_kernel {
+	RESAMPLE_KERNEL_SCALAR = 0,
+	RESAMPLE_KERNEL_SSE41,
+
+	RESAMPLE_KERNEL_COUNT
+};
+
+
+bool				resample_kernel_supported(resample_kernel kernel);
+	// returns false if the kernel is not built in or not supported by
+	// the CPU we are running on
+resample_kernel		best_resample_kernel();
+const char*			resample_kernel_name(resample_kernel kernel);
+
+
+// Separable downscaler for libheif's interleaved RGBA. The horizontal
+// pass also swaps the channels, so its output is B_RGBA32 and no extra
+// swizzle pass is needed. Rows with transparent pixels are filtered with
+// premultiplied alpha, so that the colour of invisible pixels does not
+// bleed into their neighbours. Output rows are produced in bands, each
+// band only touching the source rows its filter windows cover. The bands
+// work in scratch memory of the caller, so several threads can produce
+// bands of the same image at once.
+class Resampler {
+public:
+								Resampler(int32 sourceWidth,
+									int32 sourceHeight, int32 destWidth,
+									int32 destHeight,
+									resample_filter filter,
+									resample_kernel kernel
+										= best_resample_kernel());
+								~Resampler();
+
+			status_t			InitCheck() const { return fStatus; }
+
+			int32				DestWidth() const { return fDestWidth; }
+			int32				DestHeight() const { return fDestHeight; }
+
+			size_t				ScratchSize(int32 rowCount) const;
+				// scratch bytes any band of up to rowCount rows needs
+			status_t			ResampleRows(const uint8 *source,
+									size_t sourceStride, int32 firstRow,
+									int32 rowCount, uint8 *dest,
+									size_t destStride,
+									uint8 *scratch) const;
+				// produces output rows [firstRow, firstRow + rowCount),
+				// scratch must hold ScratchSize(rowCount) bytes
+
+	static	void				FitSize(int32 width, int32 height,
+									int32 maxSize, int32 &fitWidth,
+									int32 &fitHeight);
+				// scales width x height down so that the longer side
+				// is maxSize, keeping the aspect ratio
+
+private:
+			struct coefficients {
+				int32			*bounds;
+					// first source pixel and tap count per output pixel
+				int32			*weights;
+					// fixed point weights, taps per output pixel
+				int32			taps;
+			};
+
+			typedef void		(*horizontal_pass)(const uint8 *source,
+									uint8 *dest, int32 destWidth,
+									const int32 *bounds,
+									const int32 *weights, int32 taps);
+			typedef void		(*vertical_pass)(const uint8 *rows,
+									size_t rowBytes, int32 count,
+									const int32 *weights,
+									int32 *accumulator, uint8 *dest);
+
+			status_t			_ComputeCoefficients(int32 sourceSize,
+									int32 destSize,
+									coefficients &coefficients);
+
+			int32				fSourceWidth;
+			int32				fSourceHeight;
+			int32				fDestWidth;
+			int32				fDestHeight;
+			resample_filter		fFilter;
+			horizontal_pass		fHorizontalPass;
+			vertical_pass		fVerticalPass;
+
+			coefficients		fHorizontal;
+			coefficients		fVertical;
+
+			status_t			fStatus;
+};
+
+
+#endif // RESAMPLER_H
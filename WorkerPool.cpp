@@ -0,0 +1,265 @@
+/*
+ * WorkerPool.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "WorkerPool.h"
+
+#include <Autolock.h>
+#include <new>
+
+
+struct WorkerPool::job {
+	worker_func		function;
+	void			*data;
+	int32			count;
+	int32			next;
+		// next index to hand out, claimed with atomic_add()
+	int32			wakeUps;
+		// pool threads that may still join; the job stays queued
+		// until they have
+	int32			participants;
+		// threads currently working on the job, including the caller
+	status_t		status;
+	sem_id			done;
+	job				*nextJob;
+};
+
+
+WorkerPool::WorkerPool(int32 threadCount)
+	:
+	fLock("heic worker pool"),
+	fThreadCount(threadCount > 0 ? threadCount : CPUCount() - 1),
+	fThreads(NULL),
+	fSpawned(0),
+	fJobSem(-1),
+	fFirstJob(NULL),
+	fLastJob(NULL),
+	fQuitting(false)
+{
+}
+
+
+WorkerPool::~WorkerPool()
+{
+	if (fSpawned > 0) {
+		fLock.Lock();
+		fQuitting = true;
+		fLock.Unlock();
+
+		release_sem_etc(fJobSem, fSpawned, 0);
+		for (int32 i = 0; i < fSpawned; i++) {
+			status_t result;
+			wait_for_thread(fThreads[i], &result);
+		}
+	}
+
+	if (fJobSem >= 0)
+		delete_sem(fJobSem);
+	delete[] fThreads;
+}
+
+
+status_t
+WorkerPool::Run(worker_func function, void *data, int32 count,
+	int32 maxWorkers)
+{
+	if (count <= 0)
+		return B_OK;
+
+	job thisJob;
+	thisJob.function = function;
+	thisJob.data = data;
+	thisJob.count = count;
+	thisJob.next = 0;
+	thisJob.wakeUps = 0;
+	thisJob.participants = 1;
+	thisJob.status = B_OK;
+	thisJob.done = -1;
+	thisJob.nextJob = NULL;
+
+	// The thread count is only settled once the threads are spawned
+	int32 helpers = 0;
+	if (maxWorkers != 1 && count > 1 && _SpawnThreads() == B_OK) {
+		int32 threadCount = CountThreads();
+		helpers = maxWorkers > 0 ? maxWorkers - 1 : threadCount;
+		helpers = min_c(min_c(helpers, threadCount), count - 1);
+	}
+
+	if (helpers > 0)
+		thisJob.done = create_sem(0, "heic job done");
+
+	if (thisJob.done >= 0) {
+		thisJob.wakeUps = helpers;
+
+		fLock.Lock();
+		if (fLastJob != NULL)
+			fLastJob->nextJob = &thisJob;
+		else
+			fFirstJob = &thisJob;
+		fLastJob = &thisJob;
+		fLock.Unlock();
+
+		release_sem_etc(fJobSem, helpers, 0);
+	}
+
+	_Work(&thisJob);
+
+	if (thisJob.done < 0)
+		return thisJob.status;
+
+	// Take the job off the queue if not every helper got to it, then
+	// wait for the ones that did
+	fLock.Lock();
+	if (thisJob.wakeUps > 0) {
+		job *previous = NULL;
+		for (job *current = fFirstJob; current != NULL;
+				current = current->nextJob) {
+			if (current == &thisJob) {
+				if (previous != NULL)
+					previous->nextJob = thisJob.nextJob;
+				else
+					fFirstJob = thisJob.nextJob;
+				if (fLastJob == &thisJob)
+					fLastJob = previous;
+				break;
+			}
+			previous = current;
+		}
+	}
+	bool last = --thisJob.participants == 0;
+	fLock.Unlock();
+
+	if (!last)
+		acquire_sem(thisJob.done);
+
+	delete_sem(thisJob.done);
+	return thisJob.status;
+}
+
+
+int32
+WorkerPool::CountThreads()
+{
+	BAutolock _(fLock);
+	return fThreadCount;
+}
+
+
+/*static*/ int32
+WorkerPool::CPUCount()
+{
+	system_info info;
+	if (get_system_info(&info) != B_OK || info.cpu_count < 1)
+		return 1;
+
+	return info.cpu_count;
+}
+
+
+status_t
+WorkerPool::_SpawnThreads()
+{
+	BAutolock _(fLock);
+
+	if (fSpawned > 0)
+		return B_OK;
+	if (fThreadCount <= 0)
+		return B_ERROR;
+
+	if (fJobSem < 0) {
+		fJobSem = create_sem(0, "heic worker jobs");
+		if (fJobSem < 0)
+			return fJobSem;
+	}
+
+	if (fThreads == NULL) {
+		fThreads = new(std::nothrow) thread_id[fThreadCount];
+		if (fThreads == NULL)
+			return B_NO_MEMORY;
+	}
+
+	for (int32 i = 0; i < fThreadCount; i++) {
+		thread_id thread = spawn_thread(&_WorkerThread, "heic worker",
+			B_NORMAL_PRIORITY, this);
+		if (thread < 0)
+			break;
+
+		fThreads[fSpawned++] = thread;
+		resume_thread(thread);
+	}
+
+	if (fSpawned == 0)
+		return B_ERROR;
+
+	// Use whatever we got
+	fThreadCount = fSpawned;
+	return B_OK;
+}
+
+
+void
+WorkerPool::_Work(job *job)
+{
+	while (true) {
+		int32 index = atomic_add(&job->next, 1);
+		if (index >= job->count)
+			break;
+
+		status_t status = job->function(job->data, index);
+		if (status != B_OK) {
+			// stop handing out further indices
+			atomic_add(&job->next, job->count);
+
+			fLock.Lock();
+			if (job->status == B_OK)
+				job->status = status;
+			fLock.Unlock();
+		}
+	}
+}
+
+
+/*static*/ status_t
+WorkerPool::_WorkerThread(void *data)
+{
+	WorkerPool *pool = (WorkerPool *)data;
+
+	while (acquire_sem(pool->fJobSem) == B_OK) {
+		pool->fLock.Lock();
+		if (pool->fQuitting) {
+			pool->fLock.Unlock();
+			break;
+		}
+
+		// Wake ups of jobs that already finished leave nothing to do
+		job *job = pool->fFirstJob;
+		if (job == NULL) {
+			pool->fLock.Unlock();
+			continue;
+		}
+
+		if (--job->wakeUps == 0) {
+			pool->fFirstJob = job->nextJob;
+			if (pool->fLastJob == job)
+				pool->fLastJob = NULL;
+		}
+		job->participants++;
+		pool->fLock.Unlock();
+
+		pool->_Work(job);
+
+		pool->fLock.Lock();
+		bool last = --job->participants == 0;
+		pool->fLock.Unlock();
+
+		if (last)
+			release_sem(job->done);
+	}
+
+	return B_OK;
+}
@@ -0,0 +1,62 @@
+/*
+ * WorkerPool.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+
+#include <Locker.h>
+#include <OS.h>
+
+
+typedef status_t (*worker_func)(void *data, int32 index);
+
+
+// A fixed set of threads shared by all translations running in the
+// add-on. Run() spreads the indices of one job over the calling thread
+// and up to maxWorkers - 1 pool threads; jobs of concurrent
+// translations queue up for the same threads, so the total number of
+// threads never exceeds the pool size. Threads are only spawned once
+// the first job arrives, since most applications that load the add-on
+// never translate anything.
+class WorkerPool {
+public:
+								WorkerPool(int32 threadCount = 0);
+									// 0 uses one thread per CPU, minus
+									// the calling thread
+								~WorkerPool();
+
+			int32				CountThreads();
+
+			status_t			Run(worker_func function, void *data,
+									int32 count, int32 maxWorkers = 0);
+				// calls function(data, i) for every i in [0, count) and
+				// returns when all are done; the result is the first
+				// error any call returned
+
+	static	int32				CPUCount();
+
+private:
+			struct job;
+
+			status_t			_SpawnThreads();
+			void				_Work(job *job);
+	static	status_t			_WorkerThread(void *data);
+
+			BLocker				fLock;
+			int32				fThreadCount;
+			thread_id			*fThreads;
+			int32				fSpawned;
+			sem_id				fJobSem;
+			job					*fFirstJob;
+			job					*fLastJob;
+			bool				fQuitting;
+};
+
+
+#endif // WORKERPOOL_H
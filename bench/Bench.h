@@ -0,0 +1,48 @@
+/*
+ * Bench.h – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+
+#include <OS.h>
+
+
+// The size of a 12 megapixel phone photo
+static const int32 kBenchWidth = 4032;
+static const int32 kBenchHeight = 3024;
+
+
+typedef void (*bench_func)(void *data);
+
+
+// Runs the function a few times and returns the fastest run in
+// microseconds, the one least disturbed by the rest of the system
+static inline bigtime_t
+best_time(bench_func function, void *data, int32 runs = 5)
+{
+	bigtime_t best = -1;
+	for (int32 i = 0; i < runs; i++) {
+		bigtime_t start = system_time();
+		function(data);
+		bigtime_t time = system_time() - start;
+		if (best < 0 || time < best)
+			best = time;
+	}
+	return best;
+}
+
+
+static inline double
+gigabytes_per_second(double bytes, bigtime_t time)
+{
+	return time > 0 ? bytes / time / 1000.0 : 0.0;
+}
+
+
+#endif // BENCH_H
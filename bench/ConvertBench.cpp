@@ -0,0 +1,155 @@
+/*
+ * ConvertBench.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "Bench.h"
+#include "PixelConverter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Throughput of every row converter pairing and of the Y'CbCr path on a
+// 12 megapixel image, counting the bytes read and written.
+
+static const struct {
+	color_space		space;
+	const char		*name;
+	uint32			bytes;
+} kDestinations[] = {
+	{ B_RGBA32, "B_RGBA32", 4 },
+	{ B_RGB32, "B_RGB32", 4 },
+	{ B_RGB24, "B_RGB24", 3 },
+	{ B_GRAY8, "B_GRAY8", 1 },
+	{ B_RGBA64, "B_RGBA64", 8 }
+};
+
+static const char *kSourceNames[] = {
+	"RGB8", "RGBA8", "GRAY8", "RGB10", "RGBA10", "GRAY10", "RGB12",
+	"RGBA12", "GRAY12"
+};
+
+
+struct convert_job {
+	convert_rows_func	convert;
+	swizzle_row_func	swizzle;
+	const uint8			*source;
+	size_t				sourceStride;
+	uint8				*dest;
+	size_t				destStride;
+	ycbcr_planes		planes;
+	ycbcr_coefficients	coefficients;
+};
+
+
+static void
+run_converter(void *data)
+{
+	convert_job *job = (convert_job *)data;
+	job->convert(job->source, job->sourceStride, job->dest, job->destStride,
+		kBenchWidth, kBenchHeight, 0, 0);
+}
+
+
+static void
+run_swizzle(void *data)
+{
+	convert_job *job = (convert_job *)data;
+	for (int32 y = 0; y < kBenchHeight; y++) {
+		job->swizzle(job->source + y * job->sourceStride,
+			job->dest + y * job->destStride, kBenchWidth);
+	}
+}
+
+
+static void
+run_ycbcr(void *data)
+{
+	convert_job *job = (convert_job *)data;
+	ycbcr_to_bgra(job->planes, job->coefficients, 0, kBenchHeight,
+		job->dest, job->destStride);
+}
+
+
+int
+main()
+{
+	// Large enough for the widest source and destination, 8 bytes a pixel
+	size_t size = (size_t)kBenchWidth * 8 * kBenchHeight;
+	uint8 *source = new uint8[size];
+	uint8 *dest = new uint8[size];
+	for (size_t i = 0; i < size; i++)
+		source[i] = (uint8)(rand() >> 7);
+	memset(dest, 0, size);
+
+	convert_job job;
+	job.source = source;
+	job.dest = dest;
+
+	printf("%dx%d pixels, best of 5 runs\n\n", (int)kBenchWidth,
+		(int)kBenchHeight);
+
+	for (int32 kernel = SWIZZLE_SCALAR; kernel < SWIZZLE_KERNEL_COUNT;
+			kernel++) {
+		job.swizzle = get_swizzle_row_func((swizzle_kernel)kernel);
+		if (job.swizzle == NULL)
+			continue;
+
+		job.sourceStride = job.destStride = kBenchWidth * 4;
+		bigtime_t time = best_time(&run_swizzle, &job);
+		printf("swizzle %-8s           %7.2f ms %6.2f GB/s\n",
+			swizzle_kernel_name((swizzle_kernel)kernel), time / 1000.0,
+			gigabytes_per_second(2.0 * kBenchWidth * 4 * kBenchHeight, time));
+	}
+	printf("\n");
+
+	for (int32 source = 0; source < PIXEL_SOURCE_COUNT; source++) {
+		for (size_t i = 0; i < sizeof(kDestinations) / sizeof(kDestinations[0]);
+				i++) {
+			job.convert = get_pixel_converter((pixel_source)source,
+				kDestinations[i].space);
+			if (job.convert == NULL)
+				continue;
+
+			uint32 sourceBytes = pixel_source_bytes((pixel_source)source);
+			job.sourceStride = kBenchWidth * sourceBytes;
+			job.destStride = kBenchWidth * kDestinations[i].bytes;
+			bigtime_t time = best_time(&run_converter, &job);
+			printf("%-6s to %-8s          %7.2f ms %6.2f GB/s\n",
+				kSourceNames[source], kDestinations[i].name, time / 1000.0,
+				gigabytes_per_second((double)(job.sourceStride
+					+ job.destStride) * kBenchHeight, time));
+		}
+	}
+	printf("\n");
+
+	// 4:2:0 with BT.709 coefficients, as most phone photos are
+	job.planes.width = kBenchWidth;
+	job.planes.height = kBenchHeight;
+	job.planes.chromaShiftX = job.planes.chromaShiftY = 1;
+	job.planes.y = source;
+	job.planes.yStride = kBenchWidth;
+	job.planes.cb = source + kBenchWidth * kBenchHeight;
+	job.planes.cbStride = kBenchWidth / 2;
+	job.planes.cr = job.planes.cb + kBenchWidth / 2 * kBenchHeight / 2;
+	job.planes.crStride = kBenchWidth / 2;
+	job.planes.alpha = NULL;
+	job.planes.alphaStride = 0;
+	compute_ycbcr_coefficients(0.2126, 0.0722, false, job.coefficients);
+	job.destStride = kBenchWidth * 4;
+
+	bigtime_t time = best_time(&run_ycbcr, &job);
+	printf("Y'CbCr 4:2:0 to B_RGBA32          %7.2f ms %6.2f GB/s\n",
+		time / 1000.0, gigabytes_per_second(kBenchWidth * kBenchHeight
+			* (1.5 + 4), time));
+
+	delete[] source;
+	delete[] dest;
+	return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * IdentifyBench.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "Bench.h"
+#include "HEIFBrands.h"
+
+#include <ByteOrder.h>
+#include <stdio.h>
+#include <string.h>
+
+
+// What identifying a file costs once its first bytes are read: the ftyp
+// box is parsed and its brands matched, for a mix of HEIF files and
+// files of other types.
+
+static const char *kFileTypes[] = {
+	"heic mif1 heic",
+	"mif1 mif1 heic miaf MiHB",
+	"msf1 msf1 hevc heic mif1",
+	"avif mif1 avif miaf MA1B",
+	"isom isom iso2 avc1 mp41",
+	"qt   qt  ",
+	"\x89PNG\r\n\x1a\n"
+};
+
+static const int32 kFileTypeCount = sizeof(kFileTypes) / sizeof(kFileTypes[0]);
+static const int32 kRounds = 1000000;
+
+
+struct identify_job {
+	uint8			headers[kFileTypeCount][kFileTypeHeaderSize];
+	size_t			sizes[kFileTypeCount];
+	int32			matches;
+};
+
+
+// Lays out the brands of a file type as an ftyp box; anything that is
+// not a list of brands stands in for a file of another kind
+static size_t
+build_header(const char *brands, uint8 *header)
+{
+	memset(header, 0, kFileTypeHeaderSize);
+	size_t length = strlen(brands);
+	if (length % 5 != 4) {
+		memcpy(header, brands, length);
+		return kFileTypeHeaderSize;
+	}
+
+	size_t size = 8;
+	for (size_t i = 0; i < length; i += 5) {
+		memcpy(header + size, brands + i, 4);
+		size += size == 8 ? 8 : 4;
+	}
+
+	uint32 bigEndianSize = B_HOST_TO_BENDIAN_INT32(size);
+	memcpy(header, &bigEndianSize, 4);
+	memcpy(header + 4, "ftyp", 4);
+	return kFileTypeHeaderSize;
+}
+
+
+static void
+run_identify(void *data)
+{
+	identify_job *job = (identify_job *)data;
+	int32 matches = 0;
+	for (int32 round = 0; round < kRounds; round++) {
+		int32 i = round % kFileTypeCount;
+		float quality = 1;
+		float capability = 1;
+		heif_file_format format;
+		if (brands_match(read_ftyp_brands(job->headers[i], job->sizes[i]),
+				quality, capability, format))
+			matches++;
+	}
+	job->matches = matches;
+}
+
+
+int
+main()
+{
+	identify_job job;
+	for (int32 i = 0; i < kFileTypeCount; i++)
+		job.sizes[i] = build_header(kFileTypes[i], job.headers[i]);
+
+	bigtime_t time = best_time(&run_identify, &job);
+	printf("%d identifies of %d file types, %d of them HEIF, best of 5"
+		" runs\n\n", (int)kRounds, (int)kFileTypeCount,
+		(int)(job.matches * (int64)kFileTypeCount / kRounds));
+	printf("ftyp brands                 %7.2f ms %6.1f ns each\n",
+		time / 1000.0, time * 1000.0 / kRounds);
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * ResampleBench.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "Bench.h"
+#include "Resampler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Scaling a 12 megapixel image down to a 512 pixel thumbnail with every
+// filter and kernel, for opaque images and for images with transparent
+// pixels, which are premultiplied on the way.
+
+static const int32 kThumbnailSize = 512;
+
+
+struct resample_job {
+	Resampler		*resampler;
+	const uint8		*source;
+	uint8			*dest;
+	uint8			*scratch;
+};
+
+
+static void
+run_resampler(void *data)
+{
+	resample_job *job = (resample_job *)data;
+	job->resampler->ResampleRows(job->source, kBenchWidth * 4, 0,
+		job->resampler->DestHeight(), job->dest,
+		job->resampler->DestWidth() * 4, job->scratch);
+}
+
+
+int
+main()
+{
+	size_t size = (size_t)kBenchWidth * kBenchHeight * 4;
+	uint8 *opaque = new uint8[size];
+	uint8 *transparent = new uint8[size];
+	for (size_t i = 0; i < size; i++) {
+		opaque[i] = (i & 3) == 3 ? 255 : (uint8)(rand() >> 7);
+		transparent[i] = (uint8)(rand() >> 7);
+	}
+
+	int32 destWidth;
+	int32 destHeight;
+	Resampler::FitSize(kBenchWidth, kBenchHeight, kThumbnailSize, destWidth,
+		destHeight);
+	uint8 *dest = new uint8[destWidth * destHeight * 4];
+
+	printf("%dx%d to %dx%d, best of 5 runs\n\n", (int)kBenchWidth,
+		(int)kBenchHeight, (int)destWidth, (int)destHeight);
+
+	static const char *kFilterNames[] = { "box", "bilinear", "Lanczos" };
+	for (int32 filter = RESAMPLE_BOX; filter <= RESAMPLE_LANCZOS; filter++) {
+		for (int32 kernel = RESAMPLE_KERNEL_SCALAR;
+				kernel < RESAMPLE_KERNEL_COUNT; kernel++) {
+			if (!resample_kernel_supported((resample_kernel)kernel))
+				continue;
+
+			Resampler resampler(kBenchWidth, kBenchHeight, destWidth,
+				destHeight, (resample_filter)filter, (resample_kernel)kernel);
+			resample_job job;
+			job.resampler = &resampler;
+			job.dest = dest;
+			job.scratch = new uint8[resampler.ScratchSize(destHeight)];
+
+			job.source = opaque;
+			bigtime_t opaqueTime = best_time(&run_resampler, &job);
+			job.source = transparent;
+			bigtime_t transparentTime = best_time(&run_resampler, &job);
+
+			printf("%-8s %-6s  opaque %7.2f ms, transparent %7.2f ms\n",
+				kFilterNames[filter],
+				resample_kernel_name((resample_kernel)kernel),
+				opaqueTime / 1000.0, transparentTime / 1000.0);
+			delete[] job.scratch;
+		}
+	}
+
+	delete[] opaque;
+	delete[] transparent;
+	delete[] dest;
+	return 0;
+}
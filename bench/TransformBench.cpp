@@ -0,0 +1,107 @@
+/*
+ * TransformBench.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "Bench.h"
+#include "ImageTransform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// What each orientation costs when converting RGBA8 to B_RGBA32, next to
+// the upright image, and a quarter turn done the way libheif would: a
+// plain conversion followed by a separate rotation pass.
+
+struct transform_job {
+	image_transform		transform;
+	convert_rows_func	convert;
+	const uint8			*source;
+	uint8				*dest;
+	uint8				*temporary;
+};
+
+
+static void
+run_transform(void *data)
+{
+	transform_job *job = (transform_job *)data;
+	transform_rows(job->transform, job->source, kBenchWidth * 4, 4,
+		job->convert, 4, 0, job->transform.height, job->dest,
+		job->transform.width * 4);
+}
+
+
+static void
+run_two_passes(void *data)
+{
+	transform_job *job = (transform_job *)data;
+	job->convert(job->source, kBenchWidth * 4, job->temporary,
+		kBenchWidth * 4, kBenchWidth, kBenchHeight, 0, 0);
+
+	// Counter-clockwise: source column x becomes output row width - 1 - x
+	const uint32 *in = (const uint32 *)job->temporary;
+	uint32 *out = (uint32 *)job->dest;
+	for (int32 y = 0; y < kBenchHeight; y++) {
+		for (int32 x = 0; x < kBenchWidth; x++)
+			out[(kBenchWidth - 1 - x) * kBenchHeight + y] = in[x];
+		in += kBenchWidth;
+	}
+}
+
+
+int
+main()
+{
+	size_t size = (size_t)kBenchWidth * kBenchHeight * 4;
+	uint8 *source = new uint8[size];
+	uint8 *dest = new uint8[size];
+	uint8 *temporary = new uint8[size];
+	for (size_t i = 0; i < size; i++)
+		source[i] = (uint8)(rand() >> 7);
+	memset(dest, 0, size);
+	memset(temporary, 0, size);
+
+	transform_job job;
+	job.convert = get_pixel_converter(PIXEL_SOURCE_RGBA8, B_RGBA32);
+	job.source = source;
+	job.dest = dest;
+	job.temporary = temporary;
+
+	printf("%dx%d RGBA8 to B_RGBA32, best of 5 runs\n\n", (int)kBenchWidth,
+		(int)kBenchHeight);
+
+	static const char *kNames[] = { "upright", "mirrored left-right",
+		"mirrored top-bottom", "rotated 90", "rotated 180", "rotated 270" };
+	bigtime_t upright = 0;
+	for (int32 i = 0; i < 6; i++) {
+		init_image_transform(job.transform, kBenchWidth, kBenchHeight);
+		if (i == 1)
+			transform_mirror(job.transform, true);
+		else if (i == 2)
+			transform_mirror(job.transform, false);
+		else if (i > 2)
+			transform_rotate_ccw(job.transform, (i - 2) * 90);
+
+		bigtime_t time = best_time(&run_transform, &job);
+		if (i == 0)
+			upright = time;
+		printf("%-24s %7.2f ms %5.2fx\n", kNames[i], time / 1000.0,
+			(double)time / upright);
+	}
+
+	bigtime_t time = best_time(&run_two_passes, &job);
+	printf("%-24s %7.2f ms %5.2fx\n", "rotated 90 in two passes",
+		time / 1000.0, (double)time / upright);
+
+	delete[] source;
+	delete[] dest;
+	delete[] temporary;
+	return 0;
+}
@@ -0,0 +1,292 @@
+/*
+ * TranslateBench.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "HEICTranslator.h"
+
+#include <DataIO.h>
+#include <File.h>
+#include <GraphicsDefs.h>
+#include <Message.h>
+#include <OS.h>
+#include <TranslatorRoster.h>
+
+#include <libheif/heif.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+// Translating real files to bitmaps the way applications do, through the
+// translator roster into memory, and how much memory the team needs while
+// doing so. Unlike the other benchmarks this one needs Haiku and the
+// translator: "make -C bench TranslateBench", then
+// "bench/TranslateBench [-a add-on] [-t threads] [-d] file...". Without -a
+// the installed translators are used. -t translates each file again with 1
+// up to that many decoder threads and reports the grid tiles decoded per
+// second. -d translates files of more than 8 bits again, having libheif
+// convert them to 8 bits, dithering them ourselves and keeping all their
+// bits in B_RGBA64.
+
+static const int32 kRuns = 5;
+
+
+// Memory is sampled from the areas of the team while a translation runs.
+// Images are large enough that their buffers get areas of their own, which
+// are gone again once they are freed.
+struct memory_sampler {
+	int32			stop;
+	int64			peak;
+};
+
+
+static int64
+team_memory()
+{
+	int64 total = 0;
+	ssize_t cookie = 0;
+	area_info info;
+	while (get_next_area_info(B_CURRENT_TEAM, &cookie, &info) == B_OK)
+		total += info.ram_size;
+	return total;
+}
+
+
+static status_t
+sample_memory(void *data)
+{
+	memory_sampler *sampler = (memory_sampler *)data;
+	while (atomic_get(&sampler->stop) == 0) {
+		int64 memory = team_memory();
+		if (memory > sampler->peak)
+			sampler->peak = memory;
+		snooze(500);
+	}
+	return B_OK;
+}
+
+
+// The tiles of the primary image, 1 if it is not a grid image, and the
+// bits of its luma channel
+static void
+read_image_layout(const char *path, int32 &tiles, int32 &bitDepth)
+{
+	tiles = 1;
+	bitDepth = 8;
+
+	heif_context *ctx = heif_context_alloc();
+	if (ctx == NULL)
+		return;
+
+	heif_image_handle *handle = NULL;
+	heif_error error = heif_context_read_from_file(ctx, path, NULL);
+	if (error.code == heif_error_Ok)
+		error = heif_context_get_primary_image_handle(ctx, &handle);
+	if (error.code == heif_error_Ok) {
+		heif_image_tiling tiling;
+		error = heif_image_handle_get_image_tiling(handle, 1, &tiling);
+		if (error.code == heif_error_Ok)
+			tiles = tiling.num_columns * tiling.num_rows;
+		bitDepth = heif_image_handle_get_luma_bits_per_pixel(handle);
+		heif_image_handle_release(handle);
+	}
+	heif_context_free(ctx);
+}
+
+
+struct translate_result {
+	bigtime_t		time;
+	int64			peakMemory;
+	off_t			outputSize;
+};
+
+
+// Translates the file a few times, returning the fastest run and the most
+// memory any run needed beyond what the team used before
+static status_t
+translate_file(BTranslatorRoster *roster, BFile &file,
+	const translator_info &info, BMessage &ioExtension,
+	translate_result &result)
+{
+	result.time = -1;
+	result.peakMemory = 0;
+	result.outputSize = 0;
+
+	for (int32 i = 0; i < kRuns; i++) {
+		file.Seek(0, SEEK_SET);
+		BMallocIO output;
+
+		memory_sampler sampler;
+		sampler.stop = 0;
+		sampler.peak = 0;
+		int64 before = team_memory();
+		thread_id thread = spawn_thread(&sample_memory, "memory sampler",
+			B_URGENT_DISPLAY_PRIORITY, &sampler);
+		if (thread < B_OK)
+			return thread;
+		resume_thread(thread);
+
+		bigtime_t start = system_time();
+		status_t status = roster->Translate(&file, &info, &ioExtension,
+			&output, B_TRANSLATOR_BITMAP);
+		bigtime_t time = system_time() - start;
+
+		atomic_set(&sampler.stop, 1);
+		wait_for_thread(thread, NULL);
+		if (status != B_OK)
+			return status;
+
+		if (result.time < 0 || time < result.time)
+			result.time = time;
+		if (sampler.peak - before > result.peakMemory)
+			result.peakMemory = sampler.peak - before;
+		result.outputSize = output.BufferLength();
+	}
+	return B_OK;
+}
+
+
+// Ways of writing images of more than 8 bits
+struct bit_depth_mode {
+	const char		*name;
+	bool			highBitDepth;
+	color_space		colors;
+};
+
+static const bit_depth_mode kBitDepthModes[] = {
+	{ "libheif 8 bit", false, B_NO_COLOR_SPACE },
+	{ "dithered", true, B_NO_COLOR_SPACE },
+	{ "B_RGBA64", true, B_RGBA64 }
+};
+
+static const int32 kBitDepthModeCount
+	= sizeof(kBitDepthModes) / sizeof(kBitDepthModes[0]);
+
+
+static void
+usage()
+{
+	fprintf(stderr, "usage: TranslateBench [-a add-on] [-t threads] [-d] "
+		"file...\n");
+	exit(1);
+}
+
+
+int
+main(int argc, char **argv)
+{
+	const char *addOn = NULL;
+	int32 maxThreads = 0;
+	bool compareBitDepths = false;
+	int option;
+	while ((option = getopt(argc, argv, "a:t:d")) != -1) {
+		switch (option) {
+			case 'a':
+				addOn = optarg;
+				break;
+			case 't':
+				maxThreads = atoi(optarg);
+				break;
+			case 'd':
+				compareBitDepths = true;
+				break;
+			default:
+				usage();
+		}
+	}
+	if (optind >= argc)
+		usage();
+
+	BTranslatorRoster *roster = BTranslatorRoster::Default();
+	if (addOn != NULL) {
+		roster = new BTranslatorRoster();
+		status_t status = roster->AddTranslators(addOn);
+		if (status != B_OK) {
+			fprintf(stderr, "%s: %s\n", addOn, strerror(status));
+			return 1;
+		}
+	}
+
+	// Every run decodes the file again
+	BMessage ioExtension;
+	ioExtension.AddBool(HEIC_SETTING_CONTEXT_CACHE, false);
+	ioExtension.AddBool(HEIC_SETTING_DISK_CACHE, false);
+	ioExtension.AddInt32(HEIC_SETTING_BITMAP_CACHE_SIZE, 0);
+	ioExtension.AddInt32(HEIC_SETTING_DECODER_THREADS, 0);
+	ioExtension.AddBool(HEIC_SETTING_HIGH_BIT_DEPTH, true);
+	ioExtension.AddInt32(HEIC_SETTING_COLOR_SPACE, B_NO_COLOR_SPACE);
+
+	printf("best of %d runs\n\n", (int)kRuns);
+
+	for (int i = optind; i < argc; i++) {
+		BFile file(argv[i], B_READ_ONLY);
+		translator_info info;
+		status_t status = file.InitCheck();
+		if (status == B_OK) {
+			status = roster->Identify(&file, &ioExtension, &info, 0, NULL,
+				B_TRANSLATOR_BITMAP);
+		}
+
+		translate_result result;
+		if (status == B_OK)
+			status = translate_file(roster, file, info, ioExtension, result);
+		if (status != B_OK) {
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(status));
+			continue;
+		}
+
+		printf("%s: %.1f ms, %.1f MB output, %.1f MB peak memory beyond it\n",
+			argv[i], result.time / 1000.0, result.outputSize / 1048576.0,
+			(result.peakMemory - result.outputSize) / 1048576.0);
+
+		int32 tiles;
+		int32 bitDepth;
+		read_image_layout(argv[i], tiles, bitDepth);
+
+		for (int32 threads = 1; threads <= maxThreads; threads++) {
+			ioExtension.ReplaceInt32(HEIC_SETTING_DECODER_THREADS, threads);
+			status = translate_file(roster, file, info, ioExtension, result);
+			if (status != B_OK) {
+				fprintf(stderr, "%s: %s\n", argv[i], strerror(status));
+				break;
+			}
+			printf("  %2d threads: %.1f ms, %.0f tiles/s, "
+				"%.1f MB peak memory\n", (int)threads, result.time / 1000.0,
+				result.time > 0 ? tiles * 1000000.0 / result.time : 0.0,
+				(result.peakMemory - result.outputSize) / 1048576.0);
+		}
+		ioExtension.ReplaceInt32(HEIC_SETTING_DECODER_THREADS, 0);
+
+		if (!compareBitDepths || bitDepth <= 8)
+			continue;
+
+		for (int32 mode = 0; mode < kBitDepthModeCount; mode++) {
+			ioExtension.ReplaceBool(HEIC_SETTING_HIGH_BIT_DEPTH,
+				kBitDepthModes[mode].highBitDepth);
+			ioExtension.ReplaceInt32(HEIC_SETTING_COLOR_SPACE,
+				kBitDepthModes[mode].colors);
+			status = translate_file(roster, file, info, ioExtension, result);
+			if (status != B_OK) {
+				fprintf(stderr, "%s: %s\n", argv[i], strerror(status));
+				break;
+			}
+			printf("  %d bit, %-13s: %.1f ms, %.1f MB peak memory\n",
+				(int)bitDepth, kBitDepthModes[mode].name,
+				result.time / 1000.0,
+				(result.peakMemory - result.outputSize) / 1048576.0);
+		}
+		ioExtension.ReplaceBool(HEIC_SETTING_HIGH_BIT_DEPTH, true);
+		ioExtension.ReplaceInt32(HEIC_SETTING_COLOR_SPACE, B_NO_COLOR_SPACE);
+	}
+
+	if (roster != BTranslatorRoster::Default())
+		delete roster;
+	return 0;
+}
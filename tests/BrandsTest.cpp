@@ -0,0 +1,98 @@
+/*
+ * BrandsTest.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "HEIFBrands.h"
+
+#include <ByteOrder.h>
+#include <stdio.h>
+#include <string.h>
+
+
+struct brands_case {
+	const char			*brands;
+		// major brand first, then the compatible ones
+	bool				match;
+	heif_file_format	format;
+};
+
+static const brands_case kCases[] = {
+	{ "heic mif1 heic", true, HEIF_FORMAT_HEIC },
+	{ "mif1 mif1 heic", true, HEIF_FORMAT_HEIC },
+	{ "msf1 msf1 hevc heic mif1", true, HEIF_FORMAT_HEIC },
+	{ "mif1 mif1", true, HEIF_FORMAT_HEIF },
+	{ "msf1 msf1 mif1 hevc", true, HEIF_FORMAT_HEIC_SEQUENCE },
+	{ "msf1 msf1 mif1", true, HEIF_FORMAT_HEIF_SEQUENCE },
+	{ "avif mif1 avif miaf", true, HEIF_FORMAT_AVIF },
+	{ "avis msf1 avis avif mif1", true, HEIF_FORMAT_AVIF },
+	{ "avci mif1 avci", true, HEIF_FORMAT_AVCI },
+	{ "mif1 mif1 vvic", true, HEIF_FORMAT_HEIF },
+	{ "jpeg mif1 jpeg", true, HEIF_FORMAT_HEIF },
+	{ "mif1 mif1 j2ki", true, HEIF_FORMAT_HEIF },
+
+	// Sequences without an image, and codecs outside of HEIF
+	{ "msf1 msf1 hevc", false, HEIF_FORMAT_COUNT },
+	{ "hevc msf1", false, HEIF_FORMAT_COUNT },
+	{ "avis msf1 avis", false, HEIF_FORMAT_COUNT },
+	{ "avif avif", false, HEIF_FORMAT_COUNT },
+	{ "isom isom mp41", false, HEIF_FORMAT_COUNT }
+};
+
+
+// Builds an ftyp box with the brands, and a minor version after the
+// major brand
+static size_t
+build_ftyp(const char *brands, uint8 *box)
+{
+	size_t size = 8;
+	for (const char *brand = brands; *brand != '\0'; brand += 5) {
+		memcpy(box + size, brand, 4);
+		size += 4;
+		if (size == 12) {
+			memset(box + size, 0, 4);
+			size += 4;
+		}
+		if (brand[4] == '\0')
+			break;
+	}
+
+	uint32 bigEndianSize = B_HOST_TO_BENDIAN_INT32(size);
+	memcpy(box, &bigEndianSize, 4);
+	memcpy(box + 4, "ftyp", 4);
+	return size;
+}
+
+
+int
+main()
+{
+	bool passed = true;
+	for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); i++) {
+		const brands_case &test = kCases[i];
+
+		uint8 box[kFileTypeHeaderSize];
+		size_t size = build_ftyp(test.brands, box);
+
+		float quality = 1;
+		float capability = 1;
+		heif_file_format format = HEIF_FORMAT_COUNT;
+		bool match = brands_match(read_ftyp_brands(box, size), quality,
+			capability, format);
+
+		bool casePassed = match == test.match
+			&& (!match || format == test.format);
+		if (!casePassed) {
+			printf("  \"%s\": %s, format %d\n", test.brands,
+				match ? "matched" : "not matched", format);
+		}
+		passed &= casePassed;
+	}
+
+	printf("brands: %s\n", passed ? "ok" : "FAILED");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+/*
+ * DitherTest.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "ImageTransform.h"
+
+#include <ByteOrder.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Wide enough for a rotation to take more than one block
+static const int32 kWidth = 150;
+static const int32 kHeight = 70;
+
+struct conversion {
+	const char		*name;
+	pixel_source	source;
+	color_space		dest;
+	uint32			destPixelBytes;
+};
+
+static const conversion kConversions[] = {
+	{ "RGBA10 to B_RGBA32", PIXEL_SOURCE_RGBA10, B_RGBA32, 4 },
+	{ "RGBA12 to B_RGB32", PIXEL_SOURCE_RGBA12, B_RGB32, 4 },
+	{ "RGB10 to B_RGB24", PIXEL_SOURCE_RGB10, B_RGB24, 3 },
+	{ "RGB12 to B_RGBA32", PIXEL_SOURCE_RGB12, B_RGBA32, 4 }
+};
+
+
+// Picks a piece of at most max pixels, but not past the end
+static int32
+random_piece(int32 max, int32 left)
+{
+	int32 size = 1 + rand() % max;
+	return min_c(size, left);
+}
+
+
+static void
+fill_source(uint8 *source, size_t size, int32 bits)
+{
+	uint16 *samples = (uint16 *)source;
+	for (size_t i = 0; i < size / 2; i++)
+		samples[i] = B_HOST_TO_LENDIAN_INT16(rand() & ((1 << bits) - 1));
+}
+
+
+// Converting the image in rectangles of random sizes has to give the same
+// pixels as converting it in one go
+static bool
+test_pieces(const conversion &c, const uint8 *source, size_t sourceStride,
+	const uint8 *expected, uint8 *result, size_t destStride)
+{
+	convert_rows_func convert = get_pixel_converter(c.source, c.dest);
+	uint32 sourcePixelBytes = pixel_source_bytes(c.source);
+
+	memset(result, 0, destStride * kHeight);
+	for (int32 y = 0; y < kHeight;) {
+		int32 rows = random_piece(7, kHeight - y);
+		for (int32 x = 0; x < kWidth;) {
+			int32 columns = random_piece(13, kWidth - x);
+			convert(source + y * sourceStride + x * sourcePixelBytes,
+				sourceStride, result + y * destStride + x * c.destPixelBytes,
+				destStride, columns, rows, x, y);
+			x += columns;
+		}
+		y += rows;
+	}
+
+	return memcmp(expected, result, destStride * kHeight) == 0;
+}
+
+
+// transform_rows() has to give the same output however its rows are
+// split, and the plain image the same as the converter itself
+static bool
+test_transforms(const conversion &c, const uint8 *source,
+	size_t sourceStride, const uint8 *converted, uint8 *expected,
+	uint8 *result, size_t destStride)
+{
+	convert_rows_func convert = get_pixel_converter(c.source, c.dest);
+	uint32 sourcePixelBytes = pixel_source_bytes(c.source);
+
+	for (int32 i = 0; i < 6; i++) {
+		image_transform transform;
+		init_image_transform(transform, kWidth, kHeight);
+		if (i == 1)
+			transform_mirror(transform, true);
+		else if (i == 2)
+			transform_mirror(transform, false);
+		else if (i > 2)
+			transform_rotate_ccw(transform, (i - 2) * 90);
+
+		memset(expected, 0, destStride * kWidth);
+		transform_rows(transform, source, sourceStride, sourcePixelBytes,
+			convert, c.destPixelBytes, 0, transform.height, expected,
+			destStride);
+
+		if (i == 0 && memcmp(expected, converted, destStride * kHeight) != 0) {
+			printf("  %s: transformed rows differ from the plain image\n",
+				c.name);
+			return false;
+		}
+
+		memset(result, 0, destStride * kWidth);
+		for (int32 y = 0; y < transform.height;) {
+			int32 rows = random_piece(37, transform.height - y);
+			transform_rows(transform, source, sourceStride, sourcePixelBytes,
+				convert, c.destPixelBytes, y, rows, result + y * destStride,
+				destStride);
+			y += rows;
+		}
+
+		if (memcmp(expected, result, destStride * kWidth) != 0) {
+			printf("  %s: transform %" B_PRId32 " depends on the slices\n",
+				c.name, i);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	// Room for the image either way up
+	size_t sourceStride = kWidth * 8 + 6;
+	size_t destStride = max_c(kWidth, kHeight) * 4 + 4;
+	uint8 *source = new uint8[sourceStride * kHeight];
+	uint8 *converted = new uint8[destStride * kWidth];
+	uint8 *expected = new uint8[destStride * kWidth];
+	uint8 *result = new uint8[destStride * kWidth];
+
+	bool passed = true;
+	for (size_t i = 0; i < sizeof(kConversions) / sizeof(kConversions[0]);
+			i++) {
+		const conversion &c = kConversions[i];
+		fill_source(source, sourceStride * kHeight,
+			c.source >= PIXEL_SOURCE_RGB12 ? 12 : 10);
+
+		memset(converted, 0, destStride * kWidth);
+		get_pixel_converter(c.source, c.dest)(source, sourceStride,
+			converted, destStride, kWidth, kHeight, 0, 0);
+
+		bool conversionPassed = test_pieces(c, source, sourceStride,
+			converted, result, destStride)
+			&& test_transforms(c, source, sourceStride, converted, expected,
+				result, destStride);
+		printf("%s: %s\n", c.name, conversionPassed ? "ok" : "FAILED");
+		passed &= conversionPassed;
+	}
+
+	delete[] source;
+	delete[] converted;
+	delete[] expected;
+	delete[] result;
+	return passed ? 0 : 1;
+}
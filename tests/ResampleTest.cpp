@@ -0,0 +1,171 @@
+/*
+ * ResampleTest.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "Resampler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const char *kFilterNames[] = { "box", "bilinear", "Lanczos" };
+
+
+static status_t
+resample(const uint8 *source, size_t sourceStride, int32 width,
+	int32 height, int32 destWidth, int32 destHeight, resample_filter filter,
+	resample_kernel kernel, int32 bandRows, uint8 *dest, size_t destStride)
+{
+	Resampler resampler(width, height, destWidth, destHeight, filter,
+		kernel);
+	if (resampler.InitCheck() != B_OK)
+		return resampler.InitCheck();
+
+	uint8 *scratch = new uint8[resampler.ScratchSize(bandRows)];
+	status_t status = B_OK;
+	for (int32 y = 0; y < destHeight && status == B_OK; y += bandRows) {
+		status = resampler.ResampleRows(source, sourceStride, y,
+			min_c(bandRows, destHeight - y), dest + y * destStride,
+			destStride, scratch);
+	}
+
+	delete[] scratch;
+	return status;
+}
+
+
+// Every vector kernel must give the scalar kernel's result bit for bit,
+// for every filter, for opaque and transparent images, in bands of any
+// height
+static bool
+test_kernel(resample_kernel kernel)
+{
+	static const int32 kSizes[][4] = {
+		{ 1, 1, 1, 1 }, { 97, 61, 13, 7 }, { 300, 200, 37, 199 },
+		{ 64, 64, 63, 5 }
+	};
+
+	bool passed = true;
+	for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); i++) {
+		int32 width = kSizes[i][0];
+		int32 height = kSizes[i][1];
+		int32 destWidth = kSizes[i][2];
+		int32 destHeight = kSizes[i][3];
+		size_t sourceStride = width * 4 + 12;
+		size_t destStride = destWidth * 4 + 4;
+
+		uint8 *source = new uint8[sourceStride * height];
+		uint8 *expected = new uint8[destStride * destHeight];
+		uint8 *result = new uint8[destStride * destHeight];
+
+		for (int32 transparent = 0; transparent < 2; transparent++) {
+			for (size_t j = 0; j < sourceStride * height; j++)
+				source[j] = (uint8)(rand() >> 7);
+			for (int32 y = 0; !transparent && y < height; y++) {
+				for (int32 x = 0; x < width; x++)
+					source[y * sourceStride + x * 4 + 3] = 255;
+			}
+
+			for (int32 filter = RESAMPLE_BOX; filter <= RESAMPLE_LANCZOS;
+					filter++) {
+				memset(expected, 0xcd, destStride * destHeight);
+				memset(result, 0xcd, destStride * destHeight);
+				resample(source, sourceStride, width, height, destWidth,
+					destHeight, (resample_filter)filter,
+					RESAMPLE_KERNEL_SCALAR, destHeight, expected, destStride);
+				resample(source, sourceStride, width, height, destWidth,
+					destHeight, (resample_filter)filter, kernel, 3, result,
+					destStride);
+
+				if (memcmp(expected, result, destStride * destHeight) != 0) {
+					printf("  %s differs for %s, %" B_PRId32 "x%" B_PRId32
+						" to %" B_PRId32 "x%" B_PRId32 "%s\n",
+						resample_kernel_name(kernel), kFilterNames[filter],
+						width, height, destWidth, destHeight,
+						transparent ? ", transparent" : "");
+					passed = false;
+				}
+			}
+		}
+
+		delete[] source;
+		delete[] expected;
+		delete[] result;
+	}
+
+	return passed;
+}
+
+
+// Invisible pixels must not tint their neighbours: a green shape on a
+// transparent background whose hidden colour is red stays green
+static bool
+test_alpha()
+{
+	static const int32 kSize = 64;
+	static const int32 kDestSize = 11;
+	uint8 source[kSize * kSize * 4];
+	uint8 dest[kDestSize * kDestSize * 4];
+
+	for (int32 y = 0; y < kSize; y++) {
+		for (int32 x = 0; x < kSize; x++) {
+			uint8 *pixel = source + (y * kSize + x) * 4;
+			bool inside = (x / 8 + y / 8) % 2 == 0;
+			pixel[0] = inside ? 0 : 255;
+			pixel[1] = inside ? 255 : 0;
+			pixel[2] = 0;
+			pixel[3] = inside ? 255 : 0;
+		}
+	}
+
+	bool passed = true;
+	for (int32 filter = RESAMPLE_BOX; filter <= RESAMPLE_LANCZOS; filter++) {
+		resample(source, kSize * 4, kSize, kSize, kDestSize, kDestSize,
+			(resample_filter)filter, best_resample_kernel(), kDestSize, dest,
+			kDestSize * 4);
+
+		for (int32 i = 0; i < kDestSize * kDestSize; i++) {
+			// B_RGBA32 is stored as BGRA
+			const uint8 *pixel = dest + i * 4;
+			if (pixel[3] > 0 && pixel[2] > 1) {
+				printf("  %s: pixel %" B_PRId32 " is tinted red (%d) at alpha"
+					" %d\n", kFilterNames[filter], i, pixel[2], pixel[3]);
+				passed = false;
+				break;
+			}
+		}
+	}
+
+	return passed;
+}
+
+
+int
+main()
+{
+	bool passed = true;
+	for (int32 kernel = RESAMPLE_KERNEL_SCALAR;
+			kernel < RESAMPLE_KERNEL_COUNT; kernel++) {
+		const char *name = resample_kernel_name((resample_kernel)kernel);
+		if (!resample_kernel_supported((resample_kernel)kernel)) {
+			printf("%s: not supported here, skipped\n", name);
+			continue;
+		}
+
+		bool kernelPassed = test_kernel((resample_kernel)kernel);
+		printf("%s: %s\n", name, kernelPassed ? "ok" : "FAILED");
+		passed &= kernelPassed;
+	}
+
+	bool alphaPassed = test_alpha();
+	printf("premultiplied alpha: %s\n", alphaPassed ? "ok" : "FAILED");
+	passed &= alphaPassed;
+
+	return passed ? 0 : 1;
+}
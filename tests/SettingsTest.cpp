@@ -0,0 +1,76 @@
+/*
+ * SettingsTest.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "HEICTranslator.h"
+#include "RequestSettings.h"
+
+#include <Message.h>
+#include <stdio.h>
+
+
+static const TranSetting kSettings[] = {
+	{HEIC_SAVED_SETTING(HEIC_SETTING_DECODER_THREADS),
+		TRAN_SETTING_INT32, 0},
+	{HEIC_SAVED_SETTING(HEIC_SETTING_HIGH_BIT_DEPTH),
+		TRAN_SETTING_BOOL, true}
+};
+
+
+static bool
+check(const char *name, TranslatorSettings *settings, BMessage *ioExtension,
+	int32 threads, bool highBitDepth)
+{
+	// What BaseTranslator::BitsCheck() does with each request
+	if (ioExtension != NULL)
+		settings->LoadSettings(ioExtension);
+
+	int32 gotThreads = get_int32_setting(settings, ioExtension,
+		HEIC_SETTING_DECODER_THREADS);
+	bool gotHighBitDepth = get_bool_setting(settings, ioExtension,
+		HEIC_SETTING_HIGH_BIT_DEPTH);
+	if (gotThreads == threads && gotHighBitDepth == highBitDepth)
+		return true;
+
+	printf("  %s: %d threads, high bit depth %d\n", name, (int)gotThreads,
+		gotHighBitDepth);
+	return false;
+}
+
+
+int
+main()
+{
+	TranslatorSettings *settings = new TranslatorSettings(
+		"HEICTranslator_SettingsTest", kSettings,
+		sizeof(kSettings) / sizeof(kSettings[0]));
+	bool passed = true;
+
+	// A request overriding the settings only changes them for itself
+	BMessage overrides;
+	overrides.AddInt32(HEIC_SETTING_DECODER_THREADS, 2);
+	overrides.AddBool(HEIC_SETTING_HIGH_BIT_DEPTH, false);
+	passed &= check("override", settings, &overrides, 2, false);
+
+	BMessage empty;
+	passed &= check("after override", settings, &empty, 0, true);
+	passed &= check("without ioExtension", settings, NULL, 0, true);
+
+	// Giving the saved settings themselves changes them for good
+	BMessage saved;
+	saved.AddInt32(HEIC_SAVED_SETTING(HEIC_SETTING_DECODER_THREADS), 4);
+	passed &= check("saved", settings, &saved, 4, true);
+	passed &= check("after saved", settings, NULL, 4, true);
+	passed &= check("override after saved", settings, &overrides, 2, false);
+	passed &= check("after both", settings, &empty, 4, true);
+
+	settings->Release();
+
+	printf("settings: %s\n", passed ? "ok" : "FAILED");
+	return passed ? 0 : 1;
+}
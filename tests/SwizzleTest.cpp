@@ -0,0 +1,111 @@
+/*
+ * SwizzleTest.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "PixelConverter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Every vector kernel the CPU supports must match the scalar kernel bit
+// for bit, including the tail it leaves to it, at any width and with
+// source and destination rows that are not aligned to each other.
+static bool
+test_kernel(swizzle_kernel kernel)
+{
+	swizzle_row_func reference = get_swizzle_row_func(SWIZZLE_SCALAR);
+	swizzle_row_func function = get_swizzle_row_func(kernel);
+
+	static const int32 kMaxWidth = 70;
+	static const int32 kOffsets[] = { 0, 1, 3 };
+	uint8 src[kMaxWidth * 4 + 8];
+	uint8 expected[kMaxWidth * 4 + 8];
+	uint8 result[kMaxWidth * 4 + 8];
+
+	for (size_t i = 0; i < sizeof(src); i++)
+		src[i] = (uint8)(rand() >> 7);
+
+	for (int32 width = 0; width <= kMaxWidth; width++) {
+		for (size_t i = 0; i < sizeof(kOffsets) / sizeof(kOffsets[0]); i++) {
+			int32 srcOffset = kOffsets[i];
+			int32 destOffset = kOffsets[(i + 1) % 3];
+
+			memset(expected, 0xcd, sizeof(expected));
+			memset(result, 0xcd, sizeof(result));
+			reference(src + srcOffset, expected + destOffset, width);
+			function(src + srcOffset, result + destOffset, width);
+
+			// Bytes past the row must be left alone as well
+			if (memcmp(expected, result, sizeof(result)) != 0) {
+				printf("  %s differs at width %" B_PRId32 ", offsets %"
+					B_PRId32 "/%" B_PRId32 "\n", swizzle_kernel_name(kernel),
+					width, srcOffset, destOffset);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+// Whole images with padded, odd strides, through the entry point the
+// translator uses
+static bool
+test_image()
+{
+	static const int32 kWidth = 37;
+	static const int32 kHeight = 5;
+	static const size_t kSrcStride = kWidth * 4 + 7;
+	static const size_t kDestStride = kWidth * 4 + 5;
+	uint8 src[kSrcStride * kHeight];
+	uint8 expected[kDestStride * kHeight];
+	uint8 result[kDestStride * kHeight];
+
+	for (size_t i = 0; i < sizeof(src); i++)
+		src[i] = (uint8)(rand() >> 7);
+
+	memset(expected, 0xcd, sizeof(expected));
+	memset(result, 0xcd, sizeof(result));
+	swizzle_row_func reference = get_swizzle_row_func(SWIZZLE_SCALAR);
+	for (int32 y = 0; y < kHeight; y++)
+		reference(src + y * kSrcStride, expected + y * kDestStride, kWidth);
+	swizzle_rgba_to_bgra(src, kSrcStride, result, kDestStride, kWidth,
+		kHeight);
+
+	return memcmp(expected, result, sizeof(result)) == 0;
+}
+
+
+int
+main()
+{
+	bool passed = true;
+	for (int32 kernel = SWIZZLE_SCALAR; kernel < SWIZZLE_KERNEL_COUNT;
+			kernel++) {
+		const char *name = swizzle_kernel_name((swizzle_kernel)kernel);
+		if (get_swizzle_row_func((swizzle_kernel)kernel) == NULL) {
+			printf("%s: not supported here, skipped\n", name);
+			continue;
+		}
+
+		bool kernelPassed = test_kernel((swizzle_kernel)kernel);
+		printf("%s: %s\n", name, kernelPassed ? "ok" : "FAILED");
+		passed &= kernelPassed;
+	}
+
+	bool imagePassed = test_image();
+	printf("swizzle_rgba_to_bgra (%s): %s\n",
+		swizzle_kernel_name(best_swizzle_kernel()),
+		imagePassed ? "ok" : "FAILED");
+	passed &= imagePassed;
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+/*
+ * YCbCrTest.cpp – HEIC image translator for Haiku
+ *
+ * Copyright (c) 2025 Johan Wagenheim <johan@dospuntos.no>
+ *
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "PixelConverter.h"
+
+#include <libheif/heif.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// The fixed point conversion may be off by one from the exact result, but
+// not more; alpha has to be copied as is.
+static const int32 kTolerance = 1;
+
+// Against libheif's own conversion, which interpolates 4:2:0 chroma, a
+// channel may be off by this much where the colour changes quickly, and
+// by this much on average; a wrong matrix or range is off by about 5 on
+// average.
+static const int32 kLibheifLargest = 12;
+static const double kLibheifAverage = 1.5;
+
+struct matrix {
+	const char	*name;
+	double		kr;
+	double		kb;
+};
+
+static const matrix kMatrices[] = {
+	{ "BT.601", 0.299, 0.114 },
+	{ "BT.709", 0.2126, 0.0722 },
+	{ "BT.2020", 0.2627, 0.0593 }
+};
+
+struct subsampling {
+	const char	*name;
+	int32		shiftX;
+	int32		shiftY;
+};
+
+static const subsampling kSubsamplings[] = {
+	{ "4:2:0", 1, 1 },
+	{ "4:2:2", 1, 0 },
+	{ "4:4:4", 0, 0 }
+};
+
+
+static uint8
+reference_clamp(double value)
+{
+	value = floor(value + 0.5);
+	if (value < 0)
+		return 0;
+	if (value > 255)
+		return 255;
+	return (uint8)value;
+}
+
+
+// Straight from the definition of the matrix, in double precision
+static void
+reference_pixel(const matrix &m, bool fullRange, uint8 y, uint8 cb, uint8 cr,
+	uint8 *bgr)
+{
+	double kg = 1.0 - m.kr - m.kb;
+	double luma = fullRange ? y : (y - 16) * 255.0 / 219.0;
+	double pb = fullRange ? cb - 128 : (cb - 128) * 255.0 / 224.0;
+	double pr = fullRange ? cr - 128 : (cr - 128) * 255.0 / 224.0;
+
+	bgr[0] = reference_clamp(luma + 2.0 * (1.0 - m.kb) * pb);
+	bgr[1] = reference_clamp(luma - 2.0 * m.kb * (1.0 - m.kb) / kg * pb
+		- 2.0 * m.kr * (1.0 - m.kr) / kg * pr);
+	bgr[2] = reference_clamp(luma + 2.0 * (1.0 - m.kr) * pr);
+}
+
+
+static void
+fill_random(uint8 *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		data[i] = (uint8)(rand() >> 7);
+}
+
+
+// Converts a random image with padded planes and compares every pixel to
+// the reference, with nearest neighbour chroma like the translator uses.
+static bool
+test_conversion(const matrix &m, bool fullRange, const subsampling &s,
+	int32 width, int32 height, bool withAlpha)
+{
+	int32 chromaWidth = (width + (1 << s.shiftX) - 1) >> s.shiftX;
+	int32 chromaHeight = (height + (1 << s.shiftY) - 1) >> s.shiftY;
+
+	ycbcr_planes planes;
+	planes.width = width;
+	planes.height = height;
+	planes.chromaShiftX = s.shiftX;
+	planes.chromaShiftY = s.shiftY;
+	planes.yStride = width + 5;
+	planes.cbStride = chromaWidth + 3;
+	planes.crStride = chromaWidth + 7;
+	planes.alphaStride = width + 1;
+
+	// The vector kernel may read a few bytes past the end of a row
+	uint8 *y = new uint8[planes.yStride * height + 16];
+	uint8 *cb = new uint8[planes.cbStride * chromaHeight + 16];
+	uint8 *cr = new uint8[planes.crStride * chromaHeight + 16];
+	uint8 *alpha = new uint8[planes.alphaStride * height + 16];
+	fill_random(y, planes.yStride * height + 16);
+	fill_random(cb, planes.cbStride * chromaHeight + 16);
+	fill_random(cr, planes.crStride * chromaHeight + 16);
+	fill_random(alpha, planes.alphaStride * height + 16);
+	planes.y = y;
+	planes.cb = cb;
+	planes.cr = cr;
+	planes.alpha = withAlpha ? alpha : NULL;
+
+	size_t destStride = width * 4 + 12;
+	uint8 *dest = new uint8[destStride * height];
+	memset(dest, 0xcd, destStride * height);
+
+	ycbcr_coefficients coefficients;
+	compute_ycbcr_coefficients(m.kr, m.kb, fullRange, coefficients);
+	ycbcr_to_bgra(planes, coefficients, 0, height, dest, destStride);
+
+	bool passed = true;
+	for (int32 row = 0; row < height && passed; row++) {
+		int32 chromaRow = row >> s.shiftY;
+		for (int32 x = 0; x < width; x++) {
+			int32 chroma = x >> s.shiftX;
+			uint8 expected[4];
+			reference_pixel(m, fullRange, y[row * planes.yStride + x],
+				cb[chromaRow * planes.cbStride + chroma],
+				cr[chromaRow * planes.crStride + chroma], expected);
+			expected[3] = withAlpha ? alpha[row * planes.alphaStride + x]
+				: 255;
+
+			const uint8 *result = dest + row * destStride + x * 4;
+			for (int32 channel = 0; channel < 4; channel++) {
+				int32 difference = abs(result[channel] - expected[channel]);
+				if (difference > (channel < 3 ? kTolerance : 0)) {
+					printf("  %s %s %s%s: pixel %" B_PRId32 ",%" B_PRId32
+						" channel %" B_PRId32 " is %d, expected %d\n",
+						m.name, fullRange ? "full" : "limited", s.name,
+						withAlpha ? " with alpha" : "", x, row, channel,
+						result[channel], expected[channel]);
+					passed = false;
+					break;
+				}
+			}
+			if (!passed)
+				break;
+		}
+	}
+
+	delete[] y;
+	delete[] cb;
+	delete[] cr;
+	delete[] alpha;
+	delete[] dest;
+	return passed;
+}
+
+
+// Decodes a sample 4:2:0 image with libheif twice: as planes for the
+// converter, and as RGBA the way the translator had libheif convert it
+// before. libheif interpolates the chroma between samples where the
+// converter repeats the nearest one, so pixels differ where the colour
+// changes quickly, if not by much on average. The sample is a 66x46
+// image of smooth gradients in all three planes, encoded by libheif with
+// x265.
+static bool
+test_libheif(const char *path)
+{
+	heif_context *ctx = heif_context_alloc();
+	heif_image_handle *handle = NULL;
+	heif_image *planar = NULL;
+	heif_image *rgba = NULL;
+	heif_error error = heif_context_read_from_file(ctx, path, NULL);
+	if (error.code == heif_error_Ok)
+		error = heif_context_get_primary_image_handle(ctx, &handle);
+	if (error.code == heif_error_Ok) {
+		error = heif_decode_image(handle, &planar, heif_colorspace_YCbCr,
+			heif_chroma_420, NULL);
+	}
+	if (error.code == heif_error_Ok) {
+		error = heif_decode_image(handle, &rgba, heif_colorspace_RGB,
+			heif_chroma_interleaved_RGBA, NULL);
+	}
+
+	// The matrix the translator picks: from the nclx profile of the
+	// image or the file, or full range BT.601 without any
+	matrix m = kMatrices[0];
+	bool fullRange = true;
+	heif_color_profile_nclx *nclx = NULL;
+	if (error.code == heif_error_Ok
+		&& (heif_image_get_nclx_color_profile(planar, &nclx).code
+				== heif_error_Ok
+			|| heif_image_handle_get_nclx_color_profile(handle, &nclx).code
+				== heif_error_Ok)) {
+		if (nclx->matrix_coefficients
+				== heif_matrix_coefficients_ITU_R_BT_709_5)
+			m = kMatrices[1];
+		fullRange = nclx->full_range_flag != 0;
+		heif_nclx_color_profile_free(nclx);
+	}
+
+	bool passed = error.code == heif_error_Ok;
+	if (!passed)
+		printf("  %s: %s\n", path, error.message);
+
+	if (passed) {
+		int32 width = heif_image_get_width(planar, heif_channel_Y);
+		int32 height = heif_image_get_height(planar, heif_channel_Y);
+
+		ycbcr_planes planes;
+		int stride;
+		planes.width = width;
+		planes.height = height;
+		planes.chromaShiftX = 1;
+		planes.chromaShiftY = 1;
+		planes.y = heif_image_get_plane_readonly(planar, heif_channel_Y,
+			&stride);
+		planes.yStride = stride;
+		planes.cb = heif_image_get_plane_readonly(planar, heif_channel_Cb,
+			&stride);
+		planes.cbStride = stride;
+		planes.cr = heif_image_get_plane_readonly(planar, heif_channel_Cr,
+			&stride);
+		planes.crStride = stride;
+		planes.alpha = NULL;
+		planes.alphaStride = 0;
+
+		size_t destStride = width * 4;
+		uint8 *dest = new uint8[destStride * height];
+		ycbcr_coefficients coefficients;
+		compute_ycbcr_coefficients(m.kr, m.kb, fullRange, coefficients);
+		ycbcr_to_bgra(planes, coefficients, 0, height, dest, destStride);
+
+		const uint8 *expected = heif_image_get_plane_readonly(rgba,
+			heif_channel_interleaved, &stride);
+		int32 largest = 0;
+		int64 total = 0;
+		for (int32 y = 0; y < height; y++) {
+			for (int32 x = 0; x < width; x++) {
+				const uint8 *result = dest + y * destStride + x * 4;
+				const uint8 *pixel = expected + y * stride + x * 4;
+				for (int32 channel = 0; channel < 3; channel++) {
+					int32 difference = abs(result[2 - channel]
+						- pixel[channel]);
+					largest = max_c(largest, difference);
+					total += difference;
+				}
+				if (result[3] != pixel[3])
+					largest = 255;
+			}
+		}
+
+		double average = (double)total / (width * height * 3);
+		passed = largest <= kLibheifLargest && average <= kLibheifAverage;
+		if (!passed) {
+			printf("  %s %s range: largest difference %" B_PRId32
+				", average %.2f\n", m.name, fullRange ? "full" : "limited",
+				largest, average);
+		}
+		delete[] dest;
+	}
+
+	heif_image_release(planar);
+	heif_image_release(rgba);
+	heif_image_handle_release(handle);
+	heif_context_free(ctx);
+
+	printf("libheif %s: %s\n", path, passed ? "ok" : "FAILED");
+	return passed;
+}
+
+
+int
+main()
+{
+	// Odd sizes leave tails for the scalar code and half chroma samples
+	static const int32 kSizes[][2] = { { 1, 1 }, { 7, 3 }, { 37, 9 },
+		{ 130, 4 } };
+
+	bool passed = true;
+	for (size_t i = 0; i < sizeof(kMatrices) / sizeof(kMatrices[0]); i++) {
+		for (int32 range = 0; range < 2; range++) {
+			for (size_t j = 0;
+					j < sizeof(kSubsamplings) / sizeof(kSubsamplings[0]);
+					j++) {
+				bool casePassed = true;
+				for (size_t k = 0; k < sizeof(kSizes) / sizeof(kSizes[0]);
+						k++) {
+					for (int32 withAlpha = 0; withAlpha < 2; withAlpha++) {
+						casePassed &= test_conversion(kMatrices[i],
+							range == 1, kSubsamplings[j], kSizes[k][0],
+							kSizes[k][1], withAlpha == 1);
+					}
+				}
+
+				printf("%s %s range %s: %s\n", kMatrices[i].name,
+					range == 1 ? "full" : "limited", kSubsamplings[j].name,
+					casePassed ? "ok" : "FAILED");
+				passed &= casePassed;
+			}
+		}
+	}
+
+	passed &= test_libheif("data/ycbcr420.heic");
+	return passed ? 0 : 1;
+}